@@ -0,0 +1,297 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "parameters.h"
+
+/* Structure describing the search for bonds in one frame */
+struct BondSearch {
+	struct Atom *coords;
+	gint numatoms;
+	gint ncx, ncy, ncz; /* Number of cells in each direction */
+	gint *cellStart; /* Atoms of cell c are cellAtoms[cellStart[c]..cellStart[c+1]-1] */
+	gint *cellAtoms;
+	gint *atomCell; /* Cell of each atom */
+	gint cellStartAlloc, cellAtomsAlloc, atomCellAlloc;
+	double *cut2; /* Squared cutoffs of all pairs of types */
+	gint cut2Alloc;
+	gint numtypes; /* Number of types, 0 if the atoms have no types */
+	gint *pairs[MAXWORKERS]; /* Bonded pairs found by each worker */
+	gint numPairs[MAXWORKERS];
+	gint pairAlloc[MAXWORKERS];
+};
+
+/* Only the reading thread searches for bonds, so its buffers are kept
+ and reused for every frame. */
+static struct BondSearch search;
+
+/************************************************************************/
+/* Returns the cutoff of a pair of atom types from the bond options.	*/
+/************************************************************************/
+static double getCutoff(struct Configuration *config, const gchar *type1,
+		const gchar *type2) {
+	gint i;
+	struct BondRule *rule;
+
+	for (i = 0; i < config->numBondRules; i++) {
+		rule = &(config->bondRules[i]);
+		if ((!strcmp(rule->type1, type1) && !strcmp(rule->type2, type2))
+				|| (!strcmp(rule->type1, type2) && !strcmp(rule->type2, type1)))
+			return rule->cutoff;
+	}
+	return config->bondCutoff;
+}
+
+/************************************************************************/
+/* Grows a buffer of integers to hold at least size integers.		*/
+/************************************************************************/
+static gint * growBuffer(gint *buffer, gint *alloc, gint size) {
+	if (size > *alloc) {
+		*alloc = MAX(size, 2 * *alloc);
+		buffer = (gint *) g_realloc(buffer, *alloc * sizeof(gint));
+	}
+	return buffer;
+}
+
+/************************************************************************/
+/* Searches for bonds between the atoms of a part of the cells and the	*/
+/* atoms of their neighbouring cells. Each pair is only found once, by	*/
+/* the atom with the smaller index.					*/
+/************************************************************************/
+static void searchCells(gint part, gint numparts, struct BondSearch *s) {
+	gint ncells, first, last, c, cx, cy, cz, nx, ny, nz, a, b, i, j, n;
+	double dx, dy, dz, cut2;
+	struct Atom *coords;
+
+	coords = s->coords;
+	ncells = s->ncx * s->ncy * s->ncz;
+	first = (gint) ((gint64) ncells * part / numparts);
+	last = (gint) ((gint64) ncells * (part + 1) / numparts);
+	n = 0;
+
+	for (c = first; c < last; c++) {
+		cx = c % s->ncx;
+		cy = (c / s->ncx) % s->ncy;
+		cz = c / (s->ncx * s->ncy);
+		for (nz = MAX(cz - 1, 0); nz <= MIN(cz + 1, s->ncz - 1); nz++) {
+			for (ny = MAX(cy - 1, 0); ny <= MIN(cy + 1, s->ncy - 1); ny++) {
+				for (nx = MAX(cx - 1, 0); nx <= MIN(cx + 1, s->ncx - 1); nx++) {
+					for (a = s->cellStart[c]; a < s->cellStart[c + 1]; a++) {
+						i = s->cellAtoms[a];
+						b = s->cellStart[(nz * s->ncy + ny) * s->ncx + nx];
+						for (; b < s->cellStart[(nz * s->ncy + ny) * s->ncx + nx + 1];
+								b++) {
+							j = s->cellAtoms[b];
+							if (j <= i)
+								continue;
+							dx = coords[i].xcoord - coords[j].xcoord;
+							dy = coords[i].ycoord - coords[j].ycoord;
+							dz = coords[i].zcoord - coords[j].zcoord;
+							if (s->numtypes > 0)
+								cut2 = s->cut2[coords[i].atype * s->numtypes
+										+ coords[j].atype];
+							else
+								cut2 = s->cut2[0];
+							if (dx * dx + dy * dy + dz * dz >= cut2)
+								continue;
+
+							s->pairs[part] = growBuffer(s->pairs[part],
+									&(s->pairAlloc[part]), n + 2);
+							s->pairs[part][n++] = i;
+							s->pairs[part][n++] = j;
+						}
+					}
+				}
+			}
+		}
+	}
+	s->numPairs[part] = n / 2;
+}
+
+/************************************************************************/
+/* Sorts the atoms into a uniform grid of cells at least as large as	*/
+/* the largest cutoff, with at most about two cells per atom.		*/
+/************************************************************************/
+static void buildCells(struct BondSearch *s, double maxcut) {
+	gint i, c, cx, cy, cz, ncells;
+	double minx, maxx, miny, maxy, minz, maxz, cell;
+	struct Atom *coords;
+
+	coords = s->coords;
+	minx = maxx = coords[0].xcoord;
+	miny = maxy = coords[0].ycoord;
+	minz = maxz = coords[0].zcoord;
+	for (i = 1; i < s->numatoms; i++) {
+		minx = MIN(minx, coords[i].xcoord);
+		maxx = MAX(maxx, coords[i].xcoord);
+		miny = MIN(miny, coords[i].ycoord);
+		maxy = MAX(maxy, coords[i].ycoord);
+		minz = MIN(minz, coords[i].zcoord);
+		maxz = MAX(maxz, coords[i].zcoord);
+	}
+
+	cell = maxcut;
+	while ((floor((maxx - minx) / cell) + 1) * (floor((maxy - miny) / cell) + 1)
+			* (floor((maxz - minz) / cell) + 1) > 2.0 * s->numatoms + 8.0)
+		cell *= 1.26;
+	s->ncx = (gint) ((maxx - minx) / cell) + 1;
+	s->ncy = (gint) ((maxy - miny) / cell) + 1;
+	s->ncz = (gint) ((maxz - minz) / cell) + 1;
+	ncells = s->ncx * s->ncy * s->ncz;
+
+	s->cellStart = growBuffer(s->cellStart, &(s->cellStartAlloc), ncells + 1);
+	s->cellAtoms = growBuffer(s->cellAtoms, &(s->cellAtomsAlloc),
+			s->numatoms);
+
+	s->atomCell = growBuffer(s->atomCell, &(s->atomCellAlloc), s->numatoms);
+
+	/* Counting sort of the atoms by cell. */
+	memset(s->cellStart, 0, (ncells + 1) * sizeof(gint));
+	for (i = 0; i < s->numatoms; i++) {
+		cx = MIN((gint) ((coords[i].xcoord - minx) / cell), s->ncx - 1);
+		cy = MIN((gint) ((coords[i].ycoord - miny) / cell), s->ncy - 1);
+		cz = MIN((gint) ((coords[i].zcoord - minz) / cell), s->ncz - 1);
+		s->atomCell[i] = (cz * s->ncy + cy) * s->ncx + cx;
+		s->cellStart[s->atomCell[i] + 1]++;
+	}
+	for (c = 0; c < ncells; c++)
+		s->cellStart[c + 1] += s->cellStart[c];
+	for (i = 0; i < s->numatoms; i++)
+		s->cellAtoms[s->cellStart[s->atomCell[i]]++] = i;
+	for (c = ncells; c > 0; c--)
+		s->cellStart[c] = s->cellStart[c - 1];
+	s->cellStart[0] = 0;
+}
+
+/************************************************************************/
+/* Finds the bonded atoms of a frame with a cell list, so that the time	*/
+/* grows linearly with the number of atoms. The cutoffs are given by	*/
+/* the bonds and bond options, types holds the names of the numtypes	*/
+/* atom types of the frame. The bonds are stored in the frame, reusing	*/
+/* the buffers of the earlier frames of the same slot.			*/
+/************************************************************************/
+void findBonds(struct Frame *frame, gint numatoms,
+		struct Configuration *config, gchar types[][5], gint numtypes) {
+	gint i, j, k, part, numparts, total, a, b;
+	double cutoff, maxcut;
+
+	frame->numBonded = 0;
+	if ((config->bondCutoff <= 0.0 && config->numBondRules == 0)
+			|| numatoms < 2)
+		return;
+
+	/* Squared cutoffs of all pairs of types, or a single one if the
+	 atoms have no types. */
+	search.numtypes = numtypes;
+	if (MAX(numtypes * numtypes, 1) > search.cut2Alloc) {
+		search.cut2Alloc = MAX(numtypes * numtypes, 1);
+		search.cut2 = (double *) g_realloc(search.cut2,
+				search.cut2Alloc * sizeof(double));
+	}
+	maxcut = 0.0;
+	if (numtypes > 0) {
+		for (i = 0; i < numtypes; i++) {
+			for (j = 0; j < numtypes; j++) {
+				cutoff = getCutoff(config, types[i], types[j]);
+				search.cut2[i * numtypes + j] = cutoff * cutoff;
+				maxcut = MAX(maxcut, cutoff);
+			}
+		}
+	} else {
+		search.cut2[0] = config->bondCutoff * config->bondCutoff;
+		maxcut = config->bondCutoff;
+	}
+	if (maxcut <= 0.0)
+		return;
+
+	search.coords = frame->atomdata;
+	search.numatoms = numatoms;
+	buildCells(&search, maxcut);
+
+	runParallel((void (*)(gint, gint, gpointer)) searchCells, &search);
+	numparts = getNumWorkers();
+
+	/* Store the bonds of each atom after each other. */
+	frame->bondStart = growBuffer(frame->bondStart, &(frame->bondStartAlloc),
+			numatoms + 1);
+	memset(frame->bondStart, 0, (numatoms + 1) * sizeof(gint));
+	total = 0;
+	for (part = 0; part < numparts; part++) {
+		for (k = 0; k < search.numPairs[part]; k++) {
+			frame->bondStart[search.pairs[part][2 * k] + 1]++;
+			frame->bondStart[search.pairs[part][2 * k + 1] + 1]++;
+		}
+		total += search.numPairs[part];
+	}
+	for (i = 0; i < numatoms; i++)
+		frame->bondStart[i + 1] += frame->bondStart[i];
+
+	frame->bondPartner = growBuffer(frame->bondPartner,
+			&(frame->bondPartnerAlloc), MAX(2 * total, 1));
+	for (part = 0; part < numparts; part++) {
+		for (k = 0; k < search.numPairs[part]; k++) {
+			a = search.pairs[part][2 * k];
+			b = search.pairs[part][2 * k + 1];
+			frame->bondPartner[frame->bondStart[a]++] = b;
+			frame->bondPartner[frame->bondStart[b]++] = a;
+		}
+	}
+	for (i = numatoms; i > 0; i--)
+		frame->bondStart[i] = frame->bondStart[i - 1];
+	frame->bondStart[0] = 0;
+
+	frame->numBonded = numatoms;
+
+#if Debug
+	printf("Found %d bonds.\n", total);
+#endif
+}
+
+/************************************************************************/
+/* Returns the rotated atoms placed by their index, so that the bonded	*/
+/* atoms of an atom can be found while drawing. Atoms that weren't	*/
+/* rotated have index -1. Returns NULL if the frame has no bonds. The	*/
+/* atoms are held in scratch.						*/
+/************************************************************************/
+struct Atom * getBondedAtoms(struct Frame *frame, struct Atom *coords,
+		gint numatoms, struct Configuration *config, struct Scratch *scratch) {
+	struct Atom *byindex;
+	gint i;
+
+	if (frame->numBonded == 0)
+		return NULL;
+
+	byindex = (struct Atom *) growScratch(scratch,
+			frame->numBonded * sizeof(struct Atom));
+	for (i = 0; i < frame->numBonded; i++)
+		byindex[i].index = -1;
+	for (i = 0; i < numatoms; i++)
+		if (coords[i].index < frame->numBonded)
+			byindex[coords[i].index] = coords[i];
+	return byindex;
+}
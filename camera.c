@@ -0,0 +1,226 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <math.h>
+#include <stdio.h>
+#include "parameters.h"
+
+/************************************************************************/
+/* Makes the rotation matrix m that the rotate buttons give when turned	*/
+/* by the angles x, y and z in degrees from the initial orientation.	*/
+/************************************************************************/
+static void anglesToRotation(double x, double y, double z, double m[3][3]) {
+	double isin, icos, jsin, jcos, ksin, kcos;
+
+	isin = sin(x * (-PI / 180.0));
+	icos = cos(x * (-PI / 180.0));
+	jsin = sin(y * (PI / 180.0));
+	jcos = cos(y * (PI / 180.0));
+	ksin = sin(z * (-PI / 180.0));
+	kcos = cos(z * (-PI / 180.0));
+
+	m[0][0] = jcos * kcos;
+	m[0][1] = -jcos * ksin;
+	m[0][2] = jsin;
+	m[1][0] = isin * jsin * kcos + icos * ksin;
+	m[1][1] = -isin * jsin * ksin + icos * kcos;
+	m[1][2] = -isin * jcos;
+	m[2][0] = -icos * jsin * kcos + isin * ksin;
+	m[2][1] = icos * jsin * ksin + isin * kcos;
+	m[2][2] = icos * jcos;
+}
+
+/************************************************************************/
+/* Converts the rotation matrix m to the unit quaternion q (w, x, y, z).*/
+/************************************************************************/
+static void rotationToQuaternion(double m[3][3], double *q) {
+	double t, s;
+
+	t = m[0][0] + m[1][1] + m[2][2];
+	if (t > 0.0) {
+		s = 0.5 / sqrt(t + 1.0);
+		q[0] = 0.25 / s;
+		q[1] = (m[2][1] - m[1][2]) * s;
+		q[2] = (m[0][2] - m[2][0]) * s;
+		q[3] = (m[1][0] - m[0][1]) * s;
+	} else if (m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+		s = 2.0 * sqrt(1.0 + m[0][0] - m[1][1] - m[2][2]);
+		q[0] = (m[2][1] - m[1][2]) / s;
+		q[1] = 0.25 * s;
+		q[2] = (m[0][1] + m[1][0]) / s;
+		q[3] = (m[0][2] + m[2][0]) / s;
+	} else if (m[1][1] > m[2][2]) {
+		s = 2.0 * sqrt(1.0 + m[1][1] - m[0][0] - m[2][2]);
+		q[0] = (m[0][2] - m[2][0]) / s;
+		q[1] = (m[0][1] + m[1][0]) / s;
+		q[2] = 0.25 * s;
+		q[3] = (m[1][2] + m[2][1]) / s;
+	} else {
+		s = 2.0 * sqrt(1.0 + m[2][2] - m[0][0] - m[1][1]);
+		q[0] = (m[1][0] - m[0][1]) / s;
+		q[1] = (m[0][2] + m[2][0]) / s;
+		q[2] = (m[1][2] + m[2][1]) / s;
+		q[3] = 0.25 * s;
+	}
+}
+
+/************************************************************************/
+/* Converts the unit quaternion q (w, x, y, z) to the rotation matrix m.*/
+/************************************************************************/
+static void quaternionToRotation(const double *q, double m[3][3]) {
+	double w, x, y, z;
+
+	w = q[0];
+	x = q[1];
+	y = q[2];
+	z = q[3];
+
+	m[0][0] = 1.0 - 2.0 * (y * y + z * z);
+	m[0][1] = 2.0 * (x * y - w * z);
+	m[0][2] = 2.0 * (x * z + w * y);
+	m[1][0] = 2.0 * (x * y + w * z);
+	m[1][1] = 1.0 - 2.0 * (x * x + z * z);
+	m[1][2] = 2.0 * (y * z - w * x);
+	m[2][0] = 2.0 * (x * z - w * y);
+	m[2][1] = 2.0 * (y * z + w * x);
+	m[2][2] = 1.0 - 2.0 * (x * x + y * y);
+}
+
+/************************************************************************/
+/* Reads the keyframes of a camera path from file into config. Every	*/
+/* line holds the number of a frame and the x, y and z angles of the	*/
+/* camera at that frame, in degrees as with the rotate buttons, with	*/
+/* the frames in increasing order. Empty lines and lines starting with	*/
+/* # are skipped. Returns FALSE if the file can't be read.		*/
+/************************************************************************/
+gboolean readCameraPath(struct Configuration *config, const gchar *file) {
+	FILE *fp;
+	gchar buf[256], *c;
+	gint frame, line;
+	double x, y, z, m[3][3];
+	struct CameraKey *key;
+
+	fp = fopen(file, "r");
+	if (fp == NULL) {
+		printf("Error opening camera path: %s\n", file);
+		return FALSE;
+	}
+
+	config->numCameraKeys = 0;
+	line = 0;
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		line++;
+		for (c = buf; *c == ' ' || *c == '\t'; c++)
+			;
+		if (*c == '#' || *c == '\n' || *c == '\r' || *c == '\0')
+			continue;
+
+		if (sscanf(c, "%d %lf %lf %lf", &frame, &x, &y, &z) != 4 || frame < 0
+				|| (config->numCameraKeys > 0
+						&& frame <= config->cameraKeys[config->numCameraKeys - 1].frame)) {
+			printf("Invalid camera keyframe on line %d of %s\n", line, file);
+			fclose(fp);
+			return FALSE;
+		}
+		if (config->numCameraKeys == MAXCAMERAKEYS) {
+			printf("Too many camera keyframes in %s, at most %d are used\n",
+					file, MAXCAMERAKEYS);
+			break;
+		}
+
+		key = &(config->cameraKeys[config->numCameraKeys]);
+		key->frame = frame;
+		anglesToRotation(x, y, z, m);
+		rotationToQuaternion(m, key->q);
+		config->numCameraKeys++;
+	}
+	fclose(fp);
+
+	if (config->numCameraKeys == 0) {
+		printf("No camera keyframes in %s\n", file);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/************************************************************************/
+/* Computes the orientation m of the camera at frame numframe, which	*/
+/* is fractional for the steps drawn between frames, by		*/
+/* spherical linear interpolation between the keyframes around it.	*/
+/* Before the first and after the last keyframe the camera stays put.	*/
+/************************************************************************/
+void getCameraRotation(struct Configuration *config, double numframe,
+		double m[3][3]) {
+	gint i, k;
+	double t, d, theta, a, b, q0[4], q[4];
+	const struct CameraKey *keys;
+
+	keys = config->cameraKeys;
+	if (numframe <= keys[0].frame) {
+		quaternionToRotation(keys[0].q, m);
+		return;
+	}
+	k = config->numCameraKeys - 1;
+	if (numframe >= keys[k].frame) {
+		quaternionToRotation(keys[k].q, m);
+		return;
+	}
+
+	k = 1;
+	while (keys[k].frame <= numframe)
+		k++;
+	t = (numframe - keys[k - 1].frame) / (keys[k].frame - keys[k - 1].frame);
+
+	/* The quaternions q and -q are the same orientation, the one nearer
+	 to the next keyframe gives the shorter way around. */
+	d = 0.0;
+	for (i = 0; i < 4; i++)
+		d += keys[k - 1].q[i] * keys[k].q[i];
+	for (i = 0; i < 4; i++)
+		q0[i] = (d < 0.0) ? -keys[k - 1].q[i] : keys[k - 1].q[i];
+	d = fabs(d);
+
+	/* Nearly equal orientations are interpolated linearly. */
+	if (d > 0.9995) {
+		a = 1.0 - t;
+		b = t;
+	} else {
+		theta = acos(d);
+		a = sin((1.0 - t) * theta) / sin(theta);
+		b = sin(t * theta) / sin(theta);
+	}
+
+	d = 0.0;
+	for (i = 0; i < 4; i++) {
+		q[i] = a * q0[i] + b * keys[k].q[i];
+		d += q[i] * q[i];
+	}
+	d = sqrt(d);
+	for (i = 0; i < 4; i++)
+		q[i] /= d;
+
+	quaternionToRotation(q, m);
+}
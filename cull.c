@@ -0,0 +1,139 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <string.h>
+#include "parameters.h"
+
+/* The coverage mask has one bit per pixel, grouped in blocks of 4x4
+ pixels so that a whole block can be tested at once. */
+#define BLOCKSIZE 4
+#define BLOCKFULL 0xffff
+
+/************************************************************************/
+/* Marks the pixels of a block outside of the pixmap as covered, so	*/
+/* that blocks on the edges can become full.				*/
+/************************************************************************/
+static void initCoverage(guint16 *mask, gint blocksx, gint blocksy,
+		gint width, gint height) {
+	gint bx, by, px, py;
+	guint16 bits;
+
+	for (by = 0; by < blocksy; by++) {
+		for (bx = 0; bx < blocksx; bx++) {
+			bits = 0;
+			for (py = 0; py < BLOCKSIZE; py++)
+				for (px = 0; px < BLOCKSIZE; px++)
+					if (bx * BLOCKSIZE + px >= width
+							|| by * BLOCKSIZE + py >= height)
+						bits |= 1 << (py * BLOCKSIZE + px);
+			mask[by * blocksx + bx] = bits;
+		}
+	}
+}
+
+/************************************************************************/
+/* Removes the atoms that are completely hidden behind nearer atoms.	*/
+/* The atoms have to be sorted so that the nearest ones are last. They	*/
+/* are processed front to back against a coverage mask, and an atom is	*/
+/* culled if every 4x4 block its footprint touches is already fully	*/
+/* covered. The visible atoms are kept in their original order at the	*/
+/* start of coords and their number is returned. The mask is held in	*/
+/* buffers.								*/
+/************************************************************************/
+gint cullHiddenAtoms(struct Extent *extent, struct Atom *coords, gint numatoms,
+		struct Configuration *config, struct DrawBuffers *buffers) {
+	gint width, height, blocksx, blocksy, i, kept, x, y, c, r;
+	gint x0, y0, x1, y1, bx, by, px, py, dx, dy;
+	gboolean hidden;
+	guint16 *mask;
+	struct Projection proj;
+
+	width = config->absxsize + 2 * xborder;
+	if (config->tileRows > 0)
+		height = config->tileRows;
+	else
+		height = config->absysize + 2 * yborder;
+	blocksx = (width + BLOCKSIZE - 1) / BLOCKSIZE;
+	blocksy = (height + BLOCKSIZE - 1) / BLOCKSIZE;
+
+	mask = (guint16 *) growScratch(&(buffers->coverage),
+			blocksx * blocksy * sizeof(guint16));
+	initCoverage(mask, blocksx, blocksy, width, height);
+	setupProjection(extent, config, NULL, &proj);
+
+	kept = numatoms;
+	for (i = numatoms - 1; i >= 0; i--) {
+		if (!projectAtom(&proj, &coords[i], &x, &y, &c, &r))
+			continue;
+
+		if (config->mode == 0) {
+			x0 = x - r / 2;
+			y0 = y - r / 2;
+			x1 = x0 + r - 1;
+			y1 = y0 + r - 1;
+		} else {
+			x0 = x - r;
+			y0 = y - r;
+			x1 = x + r;
+			y1 = y + r;
+		}
+		x0 = CLAMP(x0, 0, width - 1);
+		y0 = CLAMP(y0, 0, height - 1);
+		x1 = CLAMP(x1, 0, width - 1);
+		y1 = CLAMP(y1, 0, height - 1);
+
+		hidden = TRUE;
+		for (by = y0 / BLOCKSIZE; by <= y1 / BLOCKSIZE && hidden; by++)
+			for (bx = x0 / BLOCKSIZE; bx <= x1 / BLOCKSIZE; bx++)
+				if (mask[by * blocksx + bx] != BLOCKFULL) {
+					hidden = FALSE;
+					break;
+				}
+		if (hidden)
+			continue;
+
+		/* Only mark the pixels the atom covers completely, the edges of
+		 circles are antialiased and don't hide what is behind them. */
+		for (py = y0; py <= y1; py++) {
+			for (px = x0; px <= x1; px++) {
+				if (config->mode != 0) {
+					dx = MAX(ABS(px - x), ABS(px + 1 - x));
+					dy = MAX(ABS(py - y), ABS(py + 1 - y));
+					if (dx * dx + dy * dy > r * r)
+						continue;
+				}
+				mask[(py / BLOCKSIZE) * blocksx + px / BLOCKSIZE] |= 1
+						<< ((py % BLOCKSIZE) * BLOCKSIZE + px % BLOCKSIZE);
+			}
+		}
+
+		coords[--kept] = coords[i];
+	}
+
+	memmove(coords, coords + kept, (numatoms - kept) * sizeof(struct Atom));
+	return numatoms - kept;
+}
@@ -0,0 +1,232 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include "parameters.h"
+
+/* Structure shared by the workers binning the atoms of one frame */
+struct DensityJob {
+	struct Extent *extent;
+	struct Atom *coords;
+	gint numatoms;
+	struct Configuration *config;
+	gint width, height; /* Size of the histogram in pixels */
+	float *counts; /* Number of atoms in each pixel */
+	float *weights; /* Sum of the weights in each pixel */
+	gint *pixel; /* Pixel of each atom, -1 if it isn't drawn */
+	gint *order; /* Atoms drawn, sorted by the band of rows they fall in */
+	gint start[MAXWORKERS][MAXWORKERS]; /* Where each worker puts the atoms of each band */
+	gint bands[MAXWORKERS + 1]; /* Where the atoms of each band start in order */
+};
+
+/************************************************************************/
+/* Returns the band of rows, one per worker, that holds the pixel.	*/
+/************************************************************************/
+static gint getBand(struct DensityJob *job, gint pixel, gint numparts) {
+	return pixel / job->width * numparts / job->height;
+}
+
+/************************************************************************/
+/* Finds the pixel of every atom in one slice of the atoms, and counts	*/
+/* how many of them fall in each band. The worker also clears its slice	*/
+/* of the shared histogram.						*/
+/************************************************************************/
+static void locateAtoms(gint part, gint numparts, struct DensityJob *job) {
+	gint i, first, last, x, y, size;
+	gint *start;
+	struct Extent *extent;
+	struct Atom *coords;
+	struct Configuration *config;
+
+	extent = job->extent;
+	coords = job->coords;
+	config = job->config;
+	start = job->start[part];
+
+	size = job->width * job->height;
+	first = (gint) ((gint64) size * part / numparts);
+	last = (gint) ((gint64) size * (part + 1) / numparts);
+	memset(job->counts + first, 0, (last - first) * sizeof(float));
+	memset(job->weights + first, 0, (last - first) * sizeof(float));
+
+	memset(start, 0, numparts * sizeof(gint));
+	first = (gint) ((gint64) job->numatoms * part / numparts);
+	last = (gint) ((gint64) job->numatoms * (part + 1) / numparts);
+
+	for (i = first; i < last; i++) {
+		job->pixel[i] = -1;
+		if (coords[i].zcoord < extent->zmin || coords[i].zcoord > extent->zmax)
+			continue;
+		x = transformAbsoluteToRelative(coords[i].xcoord, extent->xmin,
+				extent->xmax, config->absxsize);
+		y = transformAbsoluteToRelative(coords[i].ycoord, extent->ymin,
+				extent->ymax, config->absysize);
+		if (x < 0 || y <= 0 || x >= job->width || y > job->height)
+			continue;
+
+		job->pixel[i] = (job->height - y) * job->width + x;
+		start[getBand(job, job->pixel[i], numparts)]++;
+	}
+}
+
+/************************************************************************/
+/* Puts the atoms of one slice in order, each after the atoms of the	*/
+/* same band found by the workers before it.				*/
+/************************************************************************/
+static void sortAtoms(gint part, gint numparts, struct DensityJob *job) {
+	gint i, first, last;
+	gint *start;
+
+	start = job->start[part];
+	first = (gint) ((gint64) job->numatoms * part / numparts);
+	last = (gint) ((gint64) job->numatoms * (part + 1) / numparts);
+
+	for (i = first; i < last; i++)
+		if (job->pixel[i] >= 0)
+			job->order[start[getBand(job, job->pixel[i], numparts)]++] = i;
+}
+
+/************************************************************************/
+/* Bins the atoms of one band into the shared histogram. No other	*/
+/* worker writes to the rows of the band, so nothing has to be merged.	*/
+/************************************************************************/
+static void binAtoms(gint part, gint numparts, struct DensityJob *job) {
+	gint i, k, pixel;
+	struct Atom *coords;
+	struct Configuration *config;
+
+	coords = job->coords;
+	config = job->config;
+
+	for (k = job->bands[part]; k < job->bands[part + 1]; k++) {
+		i = job->order[k];
+		pixel = job->pixel[i];
+		job->counts[pixel] += 1.0;
+		if (config->density == 2)
+			job->weights[pixel] += coords[i].atype;
+		else if (config->density == 3)
+			job->weights[pixel] += coords[i].zcoord;
+	}
+}
+
+/************************************************************************/
+/* Draws the frame as a density map instead of drawing every atom. The	*/
+/* atoms are sorted by band of rows, one band per worker thread, so	*/
+/* that the workers bin them into one shared histogram, which is then	*/
+/* mapped through the colorset. Depending on the	*/
+/* density setting the color shows the logarithm of the number of	*/
+/* atoms in each pixel, or their mean type or z coordinate. The		*/
+/* histogram, the order of the atoms and the image are held in buffers.	*/
+/************************************************************************/
+void drawAtomsDensity(cairo_t *cr, struct Extent *extent, struct Atom *coords,
+		gint numatoms, struct Configuration *config,
+		struct DrawBuffers *buffers) {
+	struct DensityJob job;
+	gint i, j, k, x, y, c, stride, numparts;
+	float maxcount;
+	double value, scale;
+	guint32 *row;
+	unsigned char *data;
+	cairo_surface_t *image;
+	struct Projection proj;
+
+	job.extent = extent;
+	job.coords = coords;
+	job.numatoms = numatoms;
+	job.config = config;
+	job.width = config->absxsize;
+	job.height = config->absysize;
+
+	job.counts = (float *) growScratch(&(buffers->histogram),
+			2 * job.width * job.height * sizeof(float));
+	job.weights = job.counts + job.width * job.height;
+	job.pixel = (gint *) growScratch(&(buffers->binned),
+			2 * numatoms * sizeof(gint));
+	job.order = job.pixel + numatoms;
+
+	runParallel((void (*)(gint, gint, gpointer)) locateAtoms, &job);
+
+	/* The atoms of each band follow those of the bands before it, in the
+	 order of the workers that found them. */
+	numparts = getNumWorkers();
+	k = 0;
+	for (j = 0; j < numparts; j++) {
+		job.bands[j] = k;
+		for (i = 0; i < numparts; i++) {
+			c = job.start[i][j];
+			job.start[i][j] = k;
+			k += c;
+		}
+	}
+	job.bands[numparts] = k;
+	runParallel((void (*)(gint, gint, gpointer)) sortAtoms, &job);
+	runParallel((void (*)(gint, gint, gpointer)) binAtoms, &job);
+
+	maxcount = 0.0;
+	for (i = 0; i < job.width * job.height; i++)
+		if (job.counts[i] > maxcount)
+			maxcount = job.counts[i];
+	scale = NUMCOLORS / log(1.0 + maxcount);
+
+	setupProjection(extent, config, NULL, &proj);
+
+	image = getPixelSurface(&(buffers->pixels), job.width, job.height);
+	cairo_surface_flush(image);
+	data = cairo_image_surface_get_data(image);
+	stride = cairo_image_surface_get_stride(image);
+
+	for (y = 0; y < job.height; y++) {
+		row = (guint32 *) (data + y * stride);
+		for (x = 0; x < job.width; x++) {
+			i = y * job.width + x;
+			if (job.counts[i] == 0.0) {
+				row[x] = 0;
+				continue;
+			}
+			if (config->density == 2) {
+				value = job.weights[i] / job.counts[i];
+				c = transformAbsoluteToRelative(value, 0, config->numtypes + 1,
+						NUMCOLORS);
+			} else if (config->density == 3) {
+				value = job.weights[i] / job.counts[i];
+				c = transformAbsoluteToRelative(value, extent->zmin, extent->zmax,
+						NUMCOLORS);
+			} else
+				c = (gint) (scale * log(1.0 + job.counts[i]));
+			if (c < 0)
+				c = 0;
+			if (c >= NUMCOLORS)
+				c = NUMCOLORS - 1;
+			row[x] = proj.pixels[c][0];
+		}
+	}
+
+	cairo_surface_mark_dirty(image);
+	cairo_set_source_surface(cr, image, xborder, yborder);
+	cairo_paint(cr);
+}
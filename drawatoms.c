@@ -26,8 +26,39 @@
 #include <gtk/gtk.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 #include "parameters.h"
 
+/************************************************************************/
+/* Returns the buffer of scratch with room for at least size bytes. It	*/
+/* grows by half at a time so that frames of slowly growing size don't	*/
+/* reallocate it on every draw, the old contents are not kept.		*/
+/************************************************************************/
+gpointer growScratch(struct Scratch *scratch, gsize size) {
+	if (size > scratch->alloc || scratch->data == NULL) {
+		g_free(scratch->data);
+		scratch->alloc = MAX(MAX(size, 1), scratch->alloc + scratch->alloc / 2);
+		scratch->data = g_malloc(scratch->alloc);
+	}
+	return scratch->data;
+}
+
+/************************************************************************/
+/* Returns the image surface held in surface, made again only if it	*/
+/* doesn't have the size width x height.				*/
+/************************************************************************/
+cairo_surface_t * getPixelSurface(cairo_surface_t **surface, gint width,
+		gint height) {
+	if (*surface == NULL || cairo_image_surface_get_width(*surface) != width
+			|| cairo_image_surface_get_height(*surface) != height) {
+		if (*surface != NULL)
+			cairo_surface_destroy(*surface);
+		*surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width,
+				height);
+	}
+	return *surface;
+}
+
 /************************************************************************/
 /* Transforms relative coordinates in input file to absolute coordinates*/
 /* on the drawable pixmap.												*/
@@ -40,103 +71,309 @@ gint transformAbsoluteToRelative(double x, double xmin, double xmax, gint absxsi
 }
 
 /************************************************************************/
-/* This function does the actual drawing of the circles accordingly to	*/
-/* mode.																*/
+/* Projects an atom onto the drawable pixmap. The center of the atom in	*/
+/* pixmap coordinates, its color index and its radius are returned.	*/
+/* Returns FALSE if the atom is outside of the drawn volume. The	*/
+/* drawing mode and camera are all in the factors and tables of proj,	*/
+/* so there are no branches for them.					*/
 /************************************************************************/
-void drawAtoms(cairo_t *cr, struct Frame *frame, struct Atom *coords,
-		gint numatoms, struct Configuration *config) {
-	gint x, y, c, i, rtmp;
-	gint radius;
-	cairo_pattern_t *pat;
+gboolean projectAtom(struct Projection *proj, struct Atom *atom, gint *x,
+		gint *y, gint *c, gint *r) {
+	gint relx, rely, step;
+	double z;
+
+	z = atom->zcoord - proj->zmin;
+	relx = (gint) ((atom->xcoord - proj->xmin) * proj->xscale);
+	rely = (gint) ((atom->ycoord - proj->ymin) * proj->yscale);
+	step = (gint) CLAMP(z * proj->rstep, 0.0, RADIUSSTEPS - 1.0);
+	*c = (gint) (atom->atype * proj->ctype + z * proj->cz);
+	*r = (gint) (proj->radius[step] * (proj->distance
+			/ (proj->distance - proj->toward * atom->tcoord + proj->zshift)));
+	*x = relx + xborder;
+	*y = (proj->absysize - rely) + yborder - proj->tiletop;
+
+	return (atom->zcoord >= proj->zmin) & (atom->zcoord <= proj->zmax)
+			& (relx > 0) & (rely > 0) & (relx < proj->xlimit)
+			& (rely < proj->ylimit);
+}
+
+/************************************************************************/
+/* Computes the factors projecting the atoms of a frame, rotated into	*/
+/* the volume extent, onto the pixmap. The drawing mode, varying of	*/
+/* the size, coloring by type and the camera are all folded into the	*/
+/* factors, and the radius and faded colors are put in tables, so that	*/
+/* drawing an atom only looks them up. The drawn atoms are marked in	*/
+/* pick, the picking grid of the view, unless it is NULL.		*/
+/************************************************************************/
+void setupProjection(struct Extent *extent, struct Configuration *config,
+		struct PickGrid *pick, struct Projection *proj) {
+	gint i, j, k, radius;
+	double zsize, depthsize, rslope, rbase, cue, f, background;
 
 	radius = config->radius / 2;
+	zsize = extent->zmax - extent->zmin;
+
+	proj->xmin = extent->xmin;
+	proj->xscale = config->absxsize / (extent->xmax - extent->xmin);
+	proj->ymin = extent->ymin;
+	proj->yscale = config->absysize / (extent->ymax - extent->ymin);
+	proj->zmin = extent->zmin;
+	proj->zmax = extent->zmax;
+
+	if (config->useTypesForColoring) {
+		proj->ctype = NUMCOLORS / (config->numtypes + 1.0);
+		proj->cz = 0.0;
+	} else {
+		proj->ctype = 0.0;
+		proj->cz = NUMCOLORS / zsize;
+	}
+
+	if (config->vary == 1) {
+		rslope = 0.5 * radius / zsize;
+		rbase = 0.5 * radius;
+	} else if (config->vary == 2) {
+		rslope = -0.5 * radius / zsize;
+		rbase = radius;
+	} else {
+		rslope = 0.0;
+		rbase = radius;
+	}
+
+	/* A perspective camera scales the radius by the distance instead of
+	 the vary mode, without one it is scaled by 1 / (1 - 0 * depth). */
+	if (config->perspDist > 0.0) {
+		proj->distance = config->perspDist;
+		proj->toward = 1.0;
+		proj->zshift = extent->zcenter;
+		rslope = 0.0;
+		rbase = radius;
+	} else {
+		proj->distance = 1.0;
+		proj->toward = 0.0;
+		proj->zshift = 0.0;
+	}
+
+	/* The radius is taken at the middle of each step of z. */
+	proj->rstep = (rslope != 0.0 && zsize > 0.0) ? RADIUSSTEPS / zsize : 0.0;
+	for (i = 0; i < RADIUSSTEPS; i++)
+		proj->radius[i] = (proj->rstep > 0.0) ?
+				(gint) ((i + 0.5) / proj->rstep * rslope + rbase) : (gint) rbase;
+
+	/* Depth cueing fades atoms into the background the farther away
+	 they are. It goes by the rotated depth, not by the z the atoms are
+	 colored by, so it follows the view as it is rotated. Without it
+	 every atom is at the first step, which is the colorset itself. */
+	cue = config->depthcue ? DEPTHCUE : 0.0;
+	depthsize = MAX(extent->depthmax - extent->depthmin, 1e-9);
+	if (cue == 0.0) {
+		proj->cuenear = 0.0;
+		proj->cuestep = 0.0;
+	} else if (config->sort == 2) {
+		proj->cuenear = extent->depthmin;
+		proj->cuestep = -(CUESTEPS - 1) / depthsize;
+	} else {
+		proj->cuenear = extent->depthmax;
+		proj->cuestep = (CUESTEPS - 1) / depthsize;
+	}
+	background = config->backgroundWhite ? 1.0 : 0.0;
+	for (i = 0; i <= NUMCOLORS; i++)
+		for (k = 0; k < CUESTEPS; k++) {
+			f = cue * k / (CUESTEPS - 1.0);
+			for (j = 0; j < 3; j++)
+				proj->shade[i][k][j] = config->xcolorset[i][j]
+						+ f * (background - config->xcolorset[i][j]);
+		}
+
+	proj->xlimit = config->absxsize - radius / 2;
+	proj->ylimit = config->absysize - radius / 2;
+	proj->absysize = config->absysize;
+	proj->tiletop = config->tileTop;
+	proj->pick = pick;
+
+	/* Only the depth buffer and the density map write pixels directly. */
+	if (config->zbuffer || config->density)
+		for (i = 0; i <= NUMCOLORS; i++)
+			for (k = 0; k < CUESTEPS; k++)
+				proj->pixels[i][k] = packColor(proj->shade[i][k][0],
+						proj->shade[i][k][1], proj->shade[i][k][2]);
+}
+
+/************************************************************************/
+/* Returns the step of depth cueing of an atom at the given depth, its	*/
+/* color is proj->shade[c][step].					*/
+/************************************************************************/
+gint getCueStep(struct Projection *proj, double depth) {
+	return (gint) (CLAMP((proj->cuenear - depth) * proj->cuestep, 0.0,
+			CUESTEPS - 1.0) + 0.5);
+}
+
+/************************************************************************/
+/* Draws the halves of the bonds of an atom that are nearest to it, in	*/
+/* the current color. Drawn just before the atom itself, so the bonds	*/
+/* are covered by the atoms in front of them like the atoms are.	*/
+/************************************************************************/
+static void drawHalfBonds(cairo_t *cr, struct Projection *proj,
+		struct Frame *frame, struct Atom *byindex, struct Atom *atom, gint x,
+		gint y, gint r) {
+	gint k, px, py, pc, pr;
+	struct Atom *base, partner;
+
+	if (atom->index >= frame->numBonded
+			|| frame->bondStart[atom->index] == frame->bondStart[atom->index + 1])
+		return;
+
+	/* Periodic images are moved from the rotated atom, the bonded atoms
+	 are moved the same amount. */
+	base = &byindex[atom->index];
+	for (k = frame->bondStart[atom->index];
+			k < frame->bondStart[atom->index + 1]; k++) {
+		partner = byindex[frame->bondPartner[k]];
+		if (partner.index < 0)
+			continue;
+		partner.xcoord += atom->xcoord - base->xcoord;
+		partner.ycoord += atom->ycoord - base->ycoord;
+		partner.zcoord += atom->zcoord - base->zcoord;
+		projectAtom(proj, &partner, &px, &py, &pc, &pr);
+		cairo_move_to(cr, x, y);
+		cairo_line_to(cr, 0.5 * (x + px), 0.5 * (y + py));
+	}
+	cairo_set_line_width(cr, MAX(1.0, 0.5 * r));
+	cairo_stroke(cr);
+}
+
+/************************************************************************/
+/* Draws the atoms as plain rectangles.					*/
+/************************************************************************/
+static void drawRectangles(cairo_t *cr, struct Projection *proj,
+		struct Frame *frame, struct Atom *coords, gint numatoms,
+		struct Atom *byindex) {
+	gint x, y, c, r, i;
+	const double *color;
+
 	for (i = 0; i < numatoms; i++) {
-		x = transformAbsoluteToRelative(coords[i].xcoord, frame->xmin, frame->xmax,
-				config->absxsize);
-		y = transformAbsoluteToRelative(coords[i].ycoord, frame->ymin, frame->ymax,
-				config->absysize);
-		if (coords[i].zcoord >= frame->zmin
-				&& coords[i].zcoord <= frame->zmax) {
-
-			if (config->useTypesForColoring)
-				c = transformAbsoluteToRelative(coords[i].atype, 0, config->numtypes + 1,
-						NUMCOLORS);
-			else
-				c = transformAbsoluteToRelative(coords[i].zcoord, frame->zmin, frame->zmax,
-						NUMCOLORS);
-
-			if (config->vary == 1) {
-				rtmp = (int) (radius
-						* (0.5 * (coords[i].zcoord - frame->zmin)
-								/ (frame->zmax - frame->zmin)) + 0.5 * radius);
-			} else if (config->vary == 2) {
-				rtmp = (int) (radius
-						* (0.5 * (-coords[i].zcoord + frame->zmax)
-								/ (frame->zmax - frame->zmin)) + 0.5 * radius);
-			} else
-				rtmp = radius;
-
-			if (x > 0 && y > 0 && x < (config->absxsize - radius / 2)
-					&& y < (config->absysize - radius / 2)) {
-				if (config->mode == 0) {
-					cairo_rectangle(cr, x - rtmp / 2 + xborder,
-							(config->absysize - y) - rtmp / 2 + yborder, rtmp,
-							rtmp);
-					cairo_set_source_rgb(cr, config->xcolorset[c][0],
-							config->xcolorset[c][1], config->xcolorset[c][2]);
-					cairo_fill(cr);
-				} else if (config->mode == 1) {
-					cairo_arc(cr, x + xborder, (config->absysize - y) + yborder,
-							rtmp, 0, 2 * M_PI);
-					cairo_set_source_rgb(cr, config->xcolorset[c][0],
-							config->xcolorset[c][1], config->xcolorset[c][2]);
-					cairo_fill(cr);
-				} else if (config->mode == 2) {
-					pat = cairo_pattern_create_radial(x + xborder - rtmp / 6.0,
-							(config->absysize - y) + yborder - rtmp / 3.0,
-							rtmp / 10.0, //115.2, 102.4, 25.6,
-							x + xborder - rtmp / 3.0,
-							(config->absysize - y) + yborder - rtmp / 3.0,
-							rtmp * 1.67); //102.4,  102.4, 128.0);
-					cairo_pattern_add_color_stop_rgba(pat, 0, 1, 1, 1, 1);
-					cairo_pattern_add_color_stop_rgba(pat, 0.2,
-							config->xcolorset[c][0], config->xcolorset[c][1],
-							config->xcolorset[c][2], 1);
-					cairo_pattern_add_color_stop_rgba(pat, 1,
-							0.2 * config->xcolorset[c][0],
-							0.2 * config->xcolorset[c][1],
-							0.2 * config->xcolorset[c][2], 1);
-					cairo_set_source(cr, pat);
-					cairo_arc(cr, x + xborder, (config->absysize - y) + yborder,
-							rtmp, 0, 2 * M_PI);
-					cairo_fill(cr);
-					cairo_pattern_destroy(pat);
-				}
-			}
+		if (!projectAtom(proj, &coords[i], &x, &y, &c, &r))
+			continue;
+		color = proj->shade[c][getCueStep(proj, coords[i].tcoord)];
+		cairo_set_source_rgb(cr, color[0], color[1], color[2]);
+		if (byindex != NULL)
+			drawHalfBonds(cr, proj, frame, byindex, &coords[i], x, y, r);
+		cairo_rectangle(cr, x - r / 2, y - r / 2, r, r);
+		cairo_fill(cr);
+	}
+}
+
+/************************************************************************/
+/* Draws the atoms as plain circles.					*/
+/************************************************************************/
+static void drawCircles(cairo_t *cr, struct Projection *proj,
+		struct Frame *frame, struct Atom *coords, gint numatoms,
+		struct Atom *byindex) {
+	gint x, y, c, r, i;
+	const double *color;
+
+	for (i = 0; i < numatoms; i++) {
+		if (!projectAtom(proj, &coords[i], &x, &y, &c, &r))
+			continue;
+		color = proj->shade[c][getCueStep(proj, coords[i].tcoord)];
+		cairo_set_source_rgb(cr, color[0], color[1], color[2]);
+		if (byindex != NULL)
+			drawHalfBonds(cr, proj, frame, byindex, &coords[i], x, y, r);
+		cairo_arc(cr, x, y, r, 0, 2 * M_PI);
+		cairo_fill(cr);
+	}
+}
+
+/************************************************************************/
+/* Draws the atoms as rendered balls.					*/
+/************************************************************************/
+static void drawBalls(cairo_t *cr, struct Projection *proj,
+		struct Frame *frame, struct Atom *coords, gint numatoms,
+		struct Atom *byindex) {
+	gint x, y, c, r, i;
+	const double *color;
+	cairo_pattern_t *pat;
+
+	for (i = 0; i < numatoms; i++) {
+		if (!projectAtom(proj, &coords[i], &x, &y, &c, &r))
+			continue;
+		color = proj->shade[c][getCueStep(proj, coords[i].tcoord)];
+		if (byindex != NULL) {
+			cairo_set_source_rgb(cr, color[0], color[1], color[2]);
+			drawHalfBonds(cr, proj, frame, byindex, &coords[i], x, y, r);
 		}
+		pat = cairo_pattern_create_radial(x - r / 6.0, y - r / 3.0,
+				r / 10.0, //115.2, 102.4, 25.6,
+				x - r / 3.0, y - r / 3.0,
+				r * 1.67); //102.4,  102.4, 128.0);
+		cairo_pattern_add_color_stop_rgba(pat, 0, 1, 1, 1, 1);
+		cairo_pattern_add_color_stop_rgba(pat, 0.2, color[0], color[1],
+				color[2], 1);
+		cairo_pattern_add_color_stop_rgba(pat, 1, 0.2 * color[0],
+				0.2 * color[1], 0.2 * color[2], 1);
+		cairo_set_source(cr, pat);
+		cairo_arc(cr, x, y, r, 0, 2 * M_PI);
+		cairo_fill(cr);
+		cairo_pattern_destroy(pat);
 	}
 }
 
+/************************************************************************/
+/* Marks the atoms in the picking grid, in the order they were drawn so	*/
+/* that the atom drawn last on a pixel is the one left there.		*/
+/************************************************************************/
+static void pickAtoms(struct Projection *proj, struct Atom *coords,
+		gint numatoms, gboolean square) {
+	gint x, y, c, r, i;
+
+	for (i = 0; i < numatoms; i++)
+		if (projectAtom(proj, &coords[i], &x, &y, &c, &r))
+			markPicked(proj->pick, x, y, r, square, coords[i].index);
+}
+
+/************************************************************************/
+/* This function does the actual drawing of the circles accordingly to	*/
+/* mode. If byindex isn't NULL the bonds of the atoms are drawn too,	*/
+/* and if pick isn't NULL the atoms are marked in it.			*/
+/************************************************************************/
+void drawAtoms(cairo_t *cr, struct Frame *frame, struct Extent *extent,
+		struct Atom *coords, gint numatoms, struct Configuration *config,
+		struct Atom *byindex, struct PickGrid *pick) {
+	struct Projection proj;
+
+	setupProjection(extent, config, pick, &proj);
+
+	if (config->mode == 0)
+		drawRectangles(cr, &proj, frame, coords, numatoms, byindex);
+	else if (config->mode == 1)
+		drawCircles(cr, &proj, frame, coords, numatoms, byindex);
+	else if (config->mode == 2)
+		drawBalls(cr, &proj, frame, coords, numatoms, byindex);
+
+	if (proj.pick != NULL)
+		pickAtoms(&proj, coords, numatoms, config->mode == 0);
+}
+
 
 /************************************************************************/
-/* Clears the drawable area and draws the rectangle which represents	*/
-/* border of the simulationbox.						*/
+/* Clears the drawable area of width x height pixels and draws the	*/
+/* rectangle which represents border of the simulationbox.		*/
 /************************************************************************/
-void clearFrame(struct Context *context, cairo_t *cr) {
+void clearFrame(cairo_t *cr, struct Configuration *config, gint width,
+		gint height) {
 
-	cairo_rectangle(cr, 0.0, 0.0, context->crXSize, context->crYSize);
-	if (context->config->backgroundWhite) {
+	cairo_rectangle(cr, 0.0, 0.0, width, height);
+	if (config->backgroundWhite) {
 		cairo_set_source_rgb(cr, 1, 1, 1);
 		cairo_fill(cr);
 		cairo_rectangle(cr, xborder, yborder,
-				context->config->absxsize, context->config->absysize);
+				config->absxsize, config->absysize);
 		cairo_set_source_rgb(cr, 0, 0, 0);
 		cairo_stroke(cr);
 	} else {
 		cairo_set_source_rgb(cr, 0, 0, 0);
 		cairo_fill(cr);
 		cairo_rectangle(cr, xborder, yborder,
-				context->config->absxsize, context->config->absysize);
+				config->absxsize, config->absysize);
 		cairo_set_source_rgb(cr, 1, 1, 1);
 		cairo_stroke(cr);
 	}
@@ -144,18 +381,149 @@ void clearFrame(struct Context *context, cairo_t *cr) {
 }
 
 /************************************************************************/
+/* Draws the atoms of the current frame on top of what cr holds.	*/
 /************************************************************************/
-void drawFrame(struct Context *context, cairo_t *cr) {
-	struct Atom *newcoords;
+static void drawFrameAtoms(struct Context *context, cairo_t *cr) {
+	struct Atom *newcoords, *byindex;
+	gint numatoms, numrotated;
+	gint64 start;
+	struct Configuration *config;
+	struct DrawBuffers *buffers;
+	struct Extent *extent;
+	struct PickGrid *pick;
 
-	if (context->config->erasePreviousFrame) {
-		clearFrame(context, cr);
+	config = context->config;
+	buffers = &(context->buffers);
+	extent = &(context->transform.extent);
+
+	/* Only the drawing of the window fills the picking grid, each view
+	 has a grid of its own. */
+	pick = NULL;
+	if (context->picking) {
+		pick = &(context->pick);
+		startPicking(pick, context->currentFrame, context->owner->interpStep,
+				context->crXSize, context->crYSize);
+	}
+
+	start = g_get_monotonic_time();
+
+	newcoords = rotateAtoms(context, config, extent, &numrotated);
+	if (pick != NULL)
+		pick->extent = *extent;
+	numatoms = numrotated;
+	byindex = getBondedAtoms(context->currentFrame, newcoords, numatoms,
+			config, &(buffers->bonded));
+
+	/* Only the sorted drawing merges the periodic images while drawing,
+	 the others need all of them at once. The rotated atoms are kept for
+	 the next draw, so the culling that removes atoms works on a copy. */
+	if (context->images.num > 1
+			&& (config->density || config->zbuffer || config->cull))
+		newcoords = replicateImages(newcoords, numatoms, &(context->images),
+				config->sort == 2, &numatoms, &(buffers->images));
+	else if (config->cull && !config->density && !config->zbuffer)
+		newcoords = memcpy(growScratch(&(buffers->images),
+				numatoms * sizeof(struct Atom)), newcoords,
+				numatoms * sizeof(struct Atom));
+
+	if (config->density)
+		drawAtomsDensity(cr, extent, newcoords, numatoms, config, buffers);
+	else if (config->zbuffer)
+		drawAtomsZBuffer(cr, extent, newcoords, numatoms, config, buffers,
+				pick);
+	else if (context->images.num > 1 && !config->cull)
+		drawAtomsImages(cr, context->currentFrame, extent, newcoords,
+				numatoms, config, &(context->images), byindex, pick);
+	else {
+		if (config->cull)
+			numatoms = cullHiddenAtoms(extent, newcoords, numatoms, config,
+					buffers);
+		drawAtoms(cr, context->currentFrame, extent, newcoords, numatoms,
+				config, byindex, pick);
 	}
 
-	newcoords = rotateAtoms(context);
+	/* The time per atom decides how many atoms fit in a preview, it is
+	 only measured when the atoms were rotated. */
+	if (numrotated > 0 && !context->transform.hit)
+		context->atomDrawTime = (g_get_monotonic_time() - start)
+				/ (1000.0 * numrotated);
+}
 
-	drawAtoms(cr, context->currentFrame, newcoords, context->currentFrame->numAtoms,
-			context->config);
+/************************************************************************/
+/* Without erase the earlier frames are kept in a trail surface, which	*/
+/* fades by config->trail each time a new frame is drawn. The atoms of	*/
+/* the current frame are kept in a layer of their own, so a redraw of	*/
+/* the same frame replaces only them and the trail is never rebuilt.	*/
+/* The window and the dumps each keep a trail of their own size.	*/
+/************************************************************************/
+static void drawTrail(struct Context *context, cairo_t *cr,
+		struct Trail *trail) {
+	cairo_t *trail_cr;
+	struct Frame *frame;
+
+	frame = context->currentFrame;
 
-	g_free(newcoords);
+	if (trail->surface == NULL
+			|| cairo_image_surface_get_width(trail->surface) != context->crXSize
+			|| cairo_image_surface_get_height(trail->surface)
+					!= context->crYSize) {
+		if (trail->surface != NULL) {
+			cairo_surface_destroy(trail->surface);
+			cairo_surface_destroy(trail->layer);
+		}
+		trail->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+				context->crXSize, context->crYSize);
+		trail->layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+				context->crXSize, context->crYSize);
+		trail->frame = NULL;
+	}
+
+	if (frame != trail->frame || frame->generation != trail->generation
+			|| context->owner->interpStep != trail->step) {
+		trail_cr = cairo_create(trail->surface);
+		if (trail->frame == NULL) {
+			cairo_set_operator(trail_cr, CAIRO_OPERATOR_CLEAR);
+			cairo_paint(trail_cr);
+		} else {
+			/* Fading is one blend, the alpha of the whole trail is scaled. */
+			if (context->config->trail < 1.0) {
+				cairo_set_operator(trail_cr, CAIRO_OPERATOR_DEST_IN);
+				cairo_paint_with_alpha(trail_cr, context->config->trail);
+				cairo_set_operator(trail_cr, CAIRO_OPERATOR_OVER);
+			}
+			cairo_set_source_surface(trail_cr, trail->layer, 0, 0);
+			cairo_paint(trail_cr);
+		}
+		cairo_destroy(trail_cr);
+		trail->frame = frame;
+		trail->generation = frame->generation;
+		trail->step = context->owner->interpStep;
+	}
+
+	trail_cr = cairo_create(trail->layer);
+	cairo_set_operator(trail_cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(trail_cr);
+	cairo_set_operator(trail_cr, CAIRO_OPERATOR_OVER);
+	drawFrameAtoms(context, trail_cr);
+	cairo_destroy(trail_cr);
+
+	clearFrame(cr, context->config, context->crXSize, context->crYSize);
+	cairo_set_source_surface(cr, trail->surface, 0, 0);
+	cairo_paint(cr);
+	cairo_set_source_surface(cr, trail->layer, 0, 0);
+	cairo_paint(cr);
+}
+
+/************************************************************************/
+/* Draws the current frame on cr, trail holds the earlier frames drawn	*/
+/* on the same target when they aren't erased.				*/
+/************************************************************************/
+void drawFrame(struct Context *context, cairo_t *cr, struct Trail *trail) {
+
+	if (context->config->erasePreviousFrame) {
+		clearFrame(cr, context->config, context->crXSize,
+				context->crYSize);
+		drawFrameAtoms(context, cr);
+	} else
+		drawTrail(context, cr, trail);
 }
@@ -0,0 +1,278 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <string.h>
+#include "parameters.h"
+
+/* Structure describing one image waiting to be encoded */
+struct EncodeJob {
+	cairo_surface_t *image;
+	gchar picname[128];
+	gboolean png;
+	gint videodump; /* Set for frames of the video, as config->videodump */
+	gchar videoname[256]; /* Copied so that Apply can free the configuration */
+};
+
+static GThreadPool *encoderPool = NULL;
+static GThreadPool *videoPool = NULL; /* One thread, keeps frames in order */
+static GMutex *encoderLock = NULL;
+static GCond *encoderDone = NULL;
+static gint encoderPending = 0; /* Images queued or being encoded */
+
+/************************************************************************/
+/* Builds the name of the dumped image of a frame from the dumpname,	*/
+/* the number or time of the frame and the extension of the image type.	*/
+/************************************************************************/
+void getDumpName(struct Context *context, gchar *picname) {
+	const gchar *extension;
+	struct Configuration *config;
+
+	config = context->config;
+
+	if (config->tifjpg)
+		extension = "png";
+	else
+		extension = "jpg";
+
+	if (config->dumpnum)
+		sprintf(picname, "%s-%d.%s", config->dumpname,
+				getShownFrameNumber(context), extension);
+	else
+		sprintf(picname, "%s-%5.3f.%s", config->dumpname,
+				getShownFrameTime(context), extension);
+}
+
+/************************************************************************/
+/* Draws the current frame into a new offscreen image surface of the	*/
+/* size of the drawing area, without needing a display. The size the	*/
+/* window is drawn with is kept.					*/
+/************************************************************************/
+cairo_surface_t * renderFrameImage(struct Context *context) {
+	cairo_surface_t *image;
+	cairo_t *cr;
+	gint xsize, ysize;
+
+	xsize = context->crXSize;
+	ysize = context->crYSize;
+	context->crXSize = context->config->absxsize + 2 * xborder;
+	context->crYSize = context->config->absysize + 2 * yborder;
+
+	image = cairo_image_surface_create(CAIRO_FORMAT_RGB24, context->crXSize,
+			context->crYSize);
+	cr = cairo_create(image);
+
+	drawFrame(context, cr, &(context->dumpTrail));
+
+	cairo_destroy(cr);
+	cairo_surface_flush(image);
+
+	context->crXSize = xsize;
+	context->crYSize = ysize;
+	return image;
+}
+
+/************************************************************************/
+/* Copies the frame the window has drawn on drawn into a new image	*/
+/* surface, drawn must have the size of the drawing area.		*/
+/************************************************************************/
+static cairo_surface_t * copyFrameImage(struct Context *context,
+		cairo_surface_t *drawn) {
+	cairo_surface_t *image;
+	cairo_t *cr;
+
+	image = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+			context->config->absxsize + 2 * xborder,
+			context->config->absysize + 2 * yborder);
+	cr = cairo_create(image);
+	cairo_set_source_surface(cr, drawn, 0, 0);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+	cairo_surface_flush(image);
+	return image;
+}
+
+/************************************************************************/
+/* Writes an image surface to a png or jpeg file. Returns FALSE if the	*/
+/* file couldn't be written.						*/
+/************************************************************************/
+gboolean writeFrameImage(cairo_surface_t *image, const gchar *picname,
+		gboolean png) {
+	GdkPixbuf *pixbuf;
+	GError *error = NULL;
+	gboolean ok;
+
+	if (png) {
+		ok = (cairo_surface_write_to_png(image, picname)
+				== CAIRO_STATUS_SUCCESS);
+	} else {
+		pixbuf = gdk_pixbuf_get_from_surface(image, 0, 0,
+				cairo_image_surface_get_width(image),
+				cairo_image_surface_get_height(image));
+		ok = gdk_pixbuf_save(pixbuf, picname, "jpeg", &error, "quality",
+				"90", NULL);
+		if (error != NULL)
+			g_error_free(error);
+		g_object_unref(pixbuf);
+	}
+
+	if (!ok)
+		printf("Error writing image: %s\n", picname);
+	return ok;
+}
+
+/************************************************************************/
+/* This function is run by the encoder threads, it writes one image and	*/
+/* lets a waiting dumpFrame continue.					*/
+/************************************************************************/
+static void encodeImage(struct EncodeJob *job, gpointer unused) {
+	if (job->videodump)
+		writeVideoFrame(job->videodump, job->videoname, job->image);
+	else
+		writeFrameImage(job->image, job->picname, job->png);
+	cairo_surface_destroy(job->image);
+	g_free(job);
+
+	g_mutex_lock(encoderLock);
+	encoderPending--;
+	g_cond_broadcast(encoderDone);
+	g_mutex_unlock(encoderLock);
+}
+
+/************************************************************************/
+/* Creates the pool of threads encoding the dumped images, and a single	*/
+/* thread writing the video if one is made.				*/
+/************************************************************************/
+static void startEncoders(struct Configuration *config) {
+	gint numEncoders;
+
+	numEncoders = g_get_num_processors();
+	if (numEncoders > MAXWORKERS)
+		numEncoders = MAXWORKERS;
+	if (numEncoders < 1)
+		numEncoders = 1;
+
+	encoderLock = g_mutex_new();
+	encoderDone = g_cond_new();
+	encoderPool = g_thread_pool_new((GFunc) encodeImage, NULL, numEncoders,
+			TRUE, NULL);
+	if (encoderPool == NULL)
+		fprintf(stderr, "Creating encoder threads failed.\n");
+
+	if (config->videodump && encoderPool != NULL) {
+		videoPool = g_thread_pool_new((GFunc) encodeImage, NULL, 1, TRUE,
+				NULL);
+		if (videoPool == NULL)
+			fprintf(stderr, "Creating video thread failed.\n");
+	}
+}
+
+/************************************************************************/
+/* Waits until all queued images have been written and closes the	*/
+/* video. Called before exiting so that no dumped frames are lost.	*/
+/************************************************************************/
+void finishEncoders() {
+	if (encoderPool != NULL) {
+		g_mutex_lock(encoderLock);
+		while (encoderPending > 0)
+			g_cond_wait(encoderDone, encoderLock);
+		g_mutex_unlock(encoderLock);
+	}
+	closeVideo();
+}
+
+/************************************************************************/
+/* Hands a job to a pool, waiting first if ENCODEQUEUE jobs are already	*/
+/* waiting. Without the pool the job is done right away.		*/
+/************************************************************************/
+static void queueJob(GThreadPool *pool, struct EncodeJob *job) {
+	if (pool == NULL) {
+		if (job->videodump)
+			writeVideoFrame(job->videodump, job->videoname, job->image);
+		else
+			writeFrameImage(job->image, job->picname, job->png);
+		cairo_surface_destroy(job->image);
+		g_free(job);
+		return;
+	}
+
+	g_mutex_lock(encoderLock);
+	while (encoderPending >= ENCODEQUEUE)
+		g_cond_wait(encoderDone, encoderLock);
+	encoderPending++;
+	g_mutex_unlock(encoderLock);
+
+	g_thread_pool_push(pool, job, NULL);
+}
+
+/************************************************************************/
+/* Hands an image of the current frame to the encoder threads, and to	*/
+/* the video thread if a video is made. Only waits if ENCODEQUEUE	*/
+/* images are already waiting to be written. If drawn isn't NULL it	*/
+/* holds the frame as the window has drawn it at the size of the	*/
+/* drawing area and is copied, else the frame is rendered offscreen.	*/
+/************************************************************************/
+void dumpFrame(struct Context *context, cairo_surface_t *drawn) {
+	struct EncodeJob *job;
+	cairo_surface_t *image;
+
+#if Debug
+	printf("Creating image of frame to dump.\n");
+#endif
+
+	if (encoderPool == NULL && encoderLock == NULL)
+		startEncoders(context->config);
+
+	if (context->config->exportname[0] != '\0')
+		exportFrame(context);
+
+	if (context->config->dumpname[0] == '\0' && !context->config->videodump)
+		return;
+
+	if (drawn != NULL)
+		image = copyFrameImage(context, drawn);
+	else
+		image = renderFrameImage(context);
+
+	if (context->config->dumpname[0] != '\0') {
+		job = g_malloc(sizeof(struct EncodeJob));
+		getDumpName(context, job->picname);
+		job->png = context->config->tifjpg;
+		job->videodump = 0;
+		job->image = cairo_surface_reference(image);
+		queueJob(encoderPool, job);
+	}
+
+	if (context->config->videodump) {
+		job = g_malloc(sizeof(struct EncodeJob));
+		job->videodump = context->config->videodump;
+		strcpy(job->videoname, context->config->videoname);
+		job->image = cairo_surface_reference(image);
+		queueJob(videoPool, job);
+	}
+
+	cairo_surface_destroy(image);
+}
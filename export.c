@@ -0,0 +1,347 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "parameters.h"
+
+/* Size of the compressed data written in one IDAT chunk */
+#define PNGCHUNK 65536
+
+/* Structure describing a png file written one row at a time */
+struct PngWriter {
+	FILE *fp;
+	z_stream stream;
+	guint8 out[PNGCHUNK];
+};
+
+/************************************************************************/
+/* Stores a 32 bit value in the big endian byte order of png files.	*/
+/************************************************************************/
+static void storeBigEndian(guint8 *p, guint32 value) {
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+/************************************************************************/
+/* Writes one chunk of a png file, with its length and checksum.	*/
+/************************************************************************/
+static void writeChunk(FILE *fp, const gchar *type, const guint8 *data,
+		guint32 length) {
+	guint8 buf[4];
+	guint32 crc;
+
+	storeBigEndian(buf, length);
+	fwrite(buf, 1, 4, fp);
+	fwrite(type, 1, 4, fp);
+	crc = crc32(0, (const Bytef *) type, 4);
+	if (length > 0) {
+		fwrite(data, 1, length, fp);
+		crc = crc32(crc, data, length);
+	}
+	storeBigEndian(buf, crc);
+	fwrite(buf, 1, 4, fp);
+}
+
+/************************************************************************/
+/* Opens a png file for an 8 bit rgb image and writes its header.	*/
+/* Returns FALSE if the file can't be opened.				*/
+/************************************************************************/
+static gboolean openPng(struct PngWriter *png, const gchar *picname,
+		gint width, gint height) {
+	static const guint8 signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26,
+			'\n' };
+	guint8 header[13];
+
+	png->fp = fopen(picname, "wb");
+	if (png->fp == NULL) {
+		printf("Error writing image: %s\n", picname);
+		return FALSE;
+	}
+
+	fwrite(signature, 1, 8, png->fp);
+	storeBigEndian(header, width);
+	storeBigEndian(header + 4, height);
+	header[8] = 8; /* Bits per sample */
+	header[9] = 2; /* Rgb */
+	header[10] = 0; /* Deflate */
+	header[11] = 0; /* Adaptive filtering */
+	header[12] = 0; /* No interlace */
+	writeChunk(png->fp, "IHDR", header, 13);
+
+	memset(&(png->stream), 0, sizeof(z_stream));
+	deflateInit(&(png->stream), Z_DEFAULT_COMPRESSION);
+	return TRUE;
+}
+
+/************************************************************************/
+/* Compresses image data, writing an IDAT chunk whenever the output	*/
+/* buffer fills. With finish the rest of the stream is written out.	*/
+/************************************************************************/
+static void deflatePng(struct PngWriter *png, guint8 *data, gint length,
+		gboolean finish) {
+	gint status;
+
+	png->stream.next_in = data;
+	png->stream.avail_in = length;
+	do {
+		png->stream.next_out = png->out;
+		png->stream.avail_out = PNGCHUNK;
+		status = deflate(&(png->stream), finish ? Z_FINISH : Z_NO_FLUSH);
+		if (png->stream.avail_out < PNGCHUNK)
+			writeChunk(png->fp, "IDAT", png->out,
+					PNGCHUNK - png->stream.avail_out);
+	} while (png->stream.avail_out == 0 || (finish && status == Z_OK));
+}
+
+/************************************************************************/
+/* Finishes the compressed data and closes the png file. Returns FALSE	*/
+/* if writing the file failed.						*/
+/************************************************************************/
+static gboolean closePng(struct PngWriter *png, const gchar *picname) {
+	gboolean ok;
+
+	deflatePng(png, NULL, 0, TRUE);
+	deflateEnd(&(png->stream));
+	writeChunk(png->fp, "IEND", NULL, 0);
+
+	ok = !ferror(png->fp);
+	if (fclose(png->fp) != 0)
+		ok = FALSE;
+	if (!ok)
+		printf("Error writing image: %s\n", picname);
+	return ok;
+}
+
+/************************************************************************/
+/* Appends the rows of a rendered strip to the png file, converting	*/
+/* the pixels of cairo to rgb bytes.					*/
+/************************************************************************/
+static void writeStrip(struct PngWriter *png, cairo_surface_t *image,
+		gint rows, guint8 *row) {
+	gint x, y, width, stride;
+	guint32 pixel;
+	guint8 *data;
+
+	cairo_surface_flush(image);
+	data = cairo_image_surface_get_data(image);
+	stride = cairo_image_surface_get_stride(image);
+	width = cairo_image_surface_get_width(image);
+
+	for (y = 0; y < rows; y++) {
+		row[0] = 0; /* No filter */
+		for (x = 0; x < width; x++) {
+			pixel = ((guint32 *) (data + y * stride))[x];
+			row[1 + 3 * x] = (pixel >> 16) & 0xff;
+			row[2 + 3 * x] = (pixel >> 8) & 0xff;
+			row[3 + 3 * x] = pixel & 0xff;
+		}
+		deflatePng(png, row, 1 + 3 * width, FALSE);
+	}
+}
+
+/************************************************************************/
+/* Finds the strips of the image an atom is drawn on. The rows are	*/
+/* those the drawing modes cover, and bonds reach margin rows further.	*/
+/* Returns FALSE if the atom isn't drawn at all.			*/
+/************************************************************************/
+static gboolean getStrips(struct Projection *proj, struct Configuration *config,
+		struct Atom *atom, gint margin, gint *first, gint *last) {
+	gint x, y, c, r, y0, y1;
+
+	if (!projectAtom(proj, atom, &x, &y, &c, &r))
+		return FALSE;
+
+	/* Circles get an extra row for their antialiased edges. */
+	if (config->mode == 0) {
+		y0 = y - r / 2;
+		y1 = y0 + r - 1;
+	} else {
+		y0 = y - r - 1;
+		y1 = y + r + 1;
+	}
+	y0 = MAX(y0 - margin, 0);
+	y1 = MIN(y1 + margin, config->exportHeight - 1);
+	if (y0 > y1)
+		return FALSE;
+
+	*first = y0 / EXPORTROWS;
+	*last = y1 / EXPORTROWS;
+	return TRUE;
+}
+
+/************************************************************************/
+/* Returns how many rows the bonds of an atom can reach past it.	*/
+/************************************************************************/
+static gint getBondMargin(struct Frame *frame, struct Configuration *config,
+		struct Projection *proj) {
+	gint i;
+	double maxcut;
+
+	if (frame->numBonded == 0 || config->zbuffer)
+		return 0;
+
+	maxcut = config->bondCutoff;
+	for (i = 0; i < config->numBondRules; i++)
+		maxcut = MAX(maxcut, config->bondRules[i].cutoff);
+
+	/* The half bonds reach half way, the rest is left for perspective. */
+	return (gint) (maxcut * proj->yscale) + 1;
+}
+
+/************************************************************************/
+/* Renders the current frame at the size given with tiledump and writes	*/
+/* it to a png file. The image is drawn in strips of EXPORTROWS rows,	*/
+/* each with only the atoms that reach into it, and every strip is	*/
+/* compressed into the file as soon as it is drawn, so only one strip	*/
+/* is ever kept in memory whatever the size of the image.		*/
+/************************************************************************/
+void exportFrame(struct Context *context) {
+	static gboolean warned = FALSE;
+	struct Configuration *config, *oldconfig;
+	struct Frame *frame;
+	struct Atom *newcoords, *byindex, *strip;
+	struct Projection proj;
+	struct Extent extent;
+	struct PngWriter png;
+	cairo_surface_t *image;
+	cairo_t *cr;
+	gint numatoms, numstrips, maxstrip, margin, i, s, first, last, n;
+	gint *stripStart, *stripFill, *stripAtoms;
+	double scale;
+	gchar picname[128];
+	guint8 *row;
+
+	oldconfig = context->config;
+	frame = context->currentFrame;
+
+	if (oldconfig->density) {
+		if (!warned)
+			printf("Density maps can't be dumped with tiledump.\n");
+		warned = TRUE;
+		return;
+	}
+
+	if (oldconfig->dumpnum)
+		sprintf(picname, "%s-%d.png", oldconfig->exportname,
+				getShownFrameNumber(context));
+	else
+		sprintf(picname, "%s-%5.3f.png", oldconfig->exportname,
+				getShownFrameTime(context));
+
+	/* The atoms are scaled with the image, as if the window was made as
+	 large as the image. */
+	config = copyConfiguration(oldconfig);
+	config->absxsize = config->exportWidth - 2 * xborder;
+	config->absysize = config->exportHeight - 2 * yborder;
+	scale = MIN((double) config->absxsize / oldconfig->absxsize,
+			(double) config->absysize / oldconfig->absysize);
+	config->radius = (gint) (oldconfig->radius * scale);
+
+	/* The frame is rotated once for the whole image, the periodic images
+	 are always replicated so that every strip is drawn the same way. */
+	newcoords = rotateAtoms(context, config, &extent, &numatoms);
+	byindex = getBondedAtoms(frame, newcoords, numatoms, config,
+			&(context->buffers.bonded));
+	if (context->images.num > 1)
+		newcoords = replicateImages(newcoords, numatoms, &(context->images),
+				config->sort == 2, &numatoms, &(context->buffers.images));
+
+	/* Counting sort of the atoms by strip, keeping them in drawing order.
+	 Atoms on the edge of a strip are put in both. */
+	setupProjection(&extent, config, NULL, &proj);
+	margin = getBondMargin(frame, config, &proj);
+	numstrips = (config->exportHeight + EXPORTROWS - 1) / EXPORTROWS;
+	stripStart = g_malloc0((numstrips + 1) * sizeof(gint));
+	stripFill = g_malloc(numstrips * sizeof(gint));
+	for (i = 0; i < numatoms; i++)
+		if (getStrips(&proj, config, &newcoords[i], margin, &first, &last))
+			for (s = first; s <= last; s++)
+				stripStart[s + 1]++;
+	maxstrip = 0;
+	for (s = 0; s < numstrips; s++) {
+		maxstrip = MAX(maxstrip, stripStart[s + 1]);
+		stripStart[s + 1] += stripStart[s];
+		stripFill[s] = stripStart[s];
+	}
+	stripAtoms = g_malloc(MAX(stripStart[numstrips], 1) * sizeof(gint));
+	for (i = 0; i < numatoms; i++)
+		if (getStrips(&proj, config, &newcoords[i], margin, &first, &last))
+			for (s = first; s <= last; s++)
+				stripAtoms[stripFill[s]++] = i;
+	strip = g_malloc(MAX(maxstrip, 1) * sizeof(struct Atom));
+
+	if (openPng(&png, picname, config->exportWidth, config->exportHeight)) {
+		image = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+				config->exportWidth, EXPORTROWS);
+		row = g_malloc(1 + 3 * config->exportWidth);
+
+		for (s = 0; s < numstrips; s++) {
+			config->tileTop = s * EXPORTROWS;
+			config->tileRows = MIN(EXPORTROWS,
+					config->exportHeight - config->tileTop);
+
+			n = stripStart[s + 1] - stripStart[s];
+			for (i = 0; i < n; i++)
+				strip[i] = newcoords[stripAtoms[stripStart[s] + i]];
+
+			cr = cairo_create(image);
+			cairo_save(cr);
+			cairo_translate(cr, 0.0, -config->tileTop);
+			clearFrame(cr, config, config->exportWidth,
+					config->exportHeight);
+			cairo_restore(cr);
+
+			if (config->zbuffer)
+				drawAtomsZBuffer(cr, &extent, strip, n, config,
+						&(context->buffers), NULL);
+			else {
+				if (config->cull)
+					n = cullHiddenAtoms(&extent, strip, n, config,
+							&(context->buffers));
+				drawAtoms(cr, frame, &extent, strip, n, config, byindex,
+						NULL);
+			}
+			cairo_destroy(cr);
+
+			writeStrip(&png, image, config->tileRows, row);
+		}
+
+		closePng(&png, picname);
+		g_free(row);
+		cairo_surface_destroy(image);
+	}
+
+	g_free(strip);
+	g_free(stripAtoms);
+	g_free(stripFill);
+	g_free(stripStart);
+	free(config);
+}
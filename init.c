@@ -24,6 +24,7 @@
  */
 
 #include <gtk/gtk.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include "parameters.h"
@@ -68,6 +69,49 @@ void printhelp() {
 	printf(
 			"\tv <1/2>                Vary atomsize according to z-column data\n");
 	printf("\tsortr                  Sort atoms in reverse order\n");
+	printf(
+			"\tzbuffer                Use a depth buffer instead of sorting the atoms\n");
+	printf(
+			"\tdensity <1/2/3>        Draw a density map instead of the atoms\n");
+	printf(
+			"\tcull                   Skip atoms hidden behind nearer atoms\n");
+	printf(
+			"\tpersp <fov> <dist>     Use a perspective camera at distance <dist>\n");
+	printf(
+			"\t                       from the center, with a <fov> degree view\n");
+	printf(
+			"\tdepthcue               Fade far atoms into the background\n");
+	printf(
+			"\tslab <nx> <ny> <nz>    Draw only the atoms at distances <min> - <max>\n");
+	printf(
+			"\t     <min> <max>       along the normal (nx, ny, nz)\n");
+	printf(
+			"\ttrail <f>              Keep <f> of the earlier frames each frame when\n");
+	printf(
+			"\t                       not erasing, 0.0 - 1.0 (default: 1.0)\n");
+	printf(
+			"\tbonds <cutoff>         Draw bonds between atoms closer than <cutoff>\n");
+	printf(
+			"\tbond <t1> <t2> <cut>   Use cutoff <cut> for bonds between types t1 and t2\n");
+	printf(
+			"\tpbc <nx> <ny> <nz>     Draw nx*ny*nz periodic images of the system\n");
+	printf(
+			"\tlod <ms>               Draw only some atoms while rotating, to keep\n");
+	printf(
+			"\t                       drawing a frame under <ms> milliseconds\n");
+	printf(
+			"\tviews <n>              Show <n> views of the frames side by side, 1 - %d\n",
+			MAXVIEWS);
+	printf(
+			"\tinterpolate <k>        Draw <k> frames between every two frames read\n");
+	printf(
+			"\thermite                Interpolate along a cubic curve, not a line\n");
+	printf(
+			"\tprecision <bits>       Rotate the atoms with 64, 32 or 16 bit coordinates\n");
+	printf(
+			"\tvalidate               Compare the atoms rotated with less precision\n");
+	printf(
+			"\t                       to doubles and print the differences\n");
 	printf("\tusetypes               Color atoms depending on their type.\n");
 	printf(
 			"\ttimedel <delim>        Set the delimiter for the time in xyz header.\n");
@@ -77,9 +121,19 @@ void printhelp() {
 			"\tjpgdump <name>         Dumps an image of each frame, see below\n");
 	printf(
 			"\tdumpnum                Dumped images are named after framenumber.\n");
+	printf(
+			"\ttiledump <name> <w> <h> Dumps a <w> x <h> png of each frame, see below\n");
+	printf(
+			"\ty4mdump <file>         Writes all frames to a y4m video file\n");
+	printf(
+			"\tpipedump <command>     Pipes all frames as raw rgb24 to a command\n");
+	printf(
+			"\tbatch                  Dump all frames without opening a window.\n");
 	printf(
 			"\tonce                   Exit automatically after all frames has been shown.\n");
 	printf("\trotate <x> <y> <z>     Use initial <x>, <>y and <z> rotations\n");
+	printf(
+			"\tcamera <file>          Turn the camera along a path of keyframes\n");
 	printf(
 			"\txyz                    Input file is in xyz format (default: off)\n");
 	printf("\n");
@@ -87,7 +141,10 @@ void printhelp() {
 	printf("                                 1 plain circles\n");
 	printf("                                 2 rendered balls\n");
 	printf(" Varying of the size modes are : 1 Size decreases with z\n");
-	printf("                                 2 Size increases with z\n\n");
+	printf("                                 2 Size increases with z\n");
+	printf(" The density map modes are :     1 Color by number of atoms\n");
+	printf("                                 2 Color by mean atom type\n");
+	printf("                                 3 Color by mean z\n\n");
 	printf(
 			" - If neither cube,x,y or z maxsize is determined by input coordinates.\n");
 	printf(" - Atoms are automatically sorted by x, y and z.\n");
@@ -96,6 +153,59 @@ void printhelp() {
 	printf(
 			"   extension, gdpc adds the time or number of the frame and the extension to\n");
 	printf("   the end of the filename.\n");
+	printf(
+			" - With the batch option no display is needed, every frame is dumped\n");
+	printf("   once as fast as possible and then gdpc exits.\n");
+	printf(
+			" - y4mdump writes the frames as a %d fps y4m video, pipedump sends them to\n",
+			VIDEOFPS);
+	printf(
+			"   the standard input of a command, e.g. an encoder, as raw rgb24 frames\n");
+	printf("   of <xsize+%d> x <ysize+%d> pixels.\n", 2 * xborder, 2 * yborder);
+	printf(
+			" - tiledump renders the images in strips of %d rows and writes them as\n",
+			EXPORTROWS);
+	printf(
+			"   they are done, so they can be much larger than the window. The atoms\n");
+	printf("   are scaled with the image, density maps can't be dumped this way.\n");
+	printf(
+			" - With persp the size of the atoms depends on their distance from the\n");
+	printf("   camera, and the vary option and x and y ranges are not used.\n");
+	printf(
+			" - Bonds are drawn with the sorted drawing modes, not with zbuffer or\n");
+	printf("   density. The bond option needs an input file in xyz format.\n");
+	printf(
+			" - The periodic box used by pbc is given by the x, y and z options, or\n");
+	printf("   else by the extent of the atoms of each frame.\n");
+	printf(
+			" - Each view is rotated on its own, the buttons and setup change the view\n");
+	printf(
+			"   clicked last. All views show the same frames, which are read only once.\n");
+	printf(
+			" - The camera file has a line '<frame> <x> <y> <z>' for each keyframe, with\n");
+	printf(
+			"   the angles of the camera at that frame as with the rotate buttons.\n");
+	printf(
+			"   Between keyframes the camera turns evenly, rotations made with the\n");
+	printf("   mouse or buttons are added to it.\n");
+	printf(
+			" - With interpolate the atoms are matched by index between two frames\n");
+	printf(
+			"   read, and each frame in between is drawn and dumped as a frame of its\n");
+	printf(
+			"   own. Frames with a different number of atoms are not interpolated.\n");
+	printf(
+			"   Atoms wrapped across a periodic box move through the box instead.\n");
+	printf(
+			" - With precision 32 or 16 a copy of the coordinates is packed into floats\n");
+	printf(
+			"   or 16 bit steps across the frame when it is read, and the atoms are\n");
+	printf(
+			"   rotated from it. The steps are 1/65535 of the size of the frame. The\n");
+	printf(
+			"   copy is kept next to the full coordinates, it adds 16 or 8 bytes per\n");
+	printf(
+			"   atom of memory and makes rotating read less of it.\n");
 	printf(" - If input file is in xyz format the t column will be ignored\n");
 	printf(
 			" - The usetypes parameter is not relevant if not used with xyz input file, and\n");
@@ -299,10 +409,38 @@ struct Configuration * handleArgs(int args, char **argv) {
 				&& !settcol) {
 			config->sort = 2;
 			argl++;
+		} else if (!strcmp(c, "zbuffer") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			config->zbuffer = TRUE;
+			argl++;
+		} else if (!strcmp(c, "cull") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			config->cull = TRUE;
+			argl++;
+		} else if (!strcmp(c, "density") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 2 >= args
+					|| sscanf(argv[argl + 2], "%d", &(config->density)) != 1) {
+				printf("Invalid or missing parameter for option: density\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			if (config->density > 3 || config->density < 1) {
+				printf("Density has only three valid modes: 1, 2 or 3 !\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			argl += 2;
 		} else if (!strcmp(c, "xyz") && !setxcol && !setycol && !setzcol
 				&& !settcol) {
 			config->inputFormatXYZ = TRUE;
 			argl++;
+		} else if (!strcmp(c, "batch") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			config->batch = TRUE;
+			argl++;
 		} else if (!strcmp(c, "dumpnum") && !setxcol && !setycol && !setzcol
 				&& !settcol) {
 			config->dumpnum = TRUE;
@@ -337,6 +475,59 @@ struct Configuration * handleArgs(int args, char **argv) {
 			if (config->radius > 25)
 				config->radius = 25;
 			argl += 2;
+		} else if (!strcmp(c, "lod") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 2 >= args
+					|| sscanf(argv[argl + 2], "%d", &(config->lod)) != 1
+					|| config->lod < 0) {
+				printf("Invalid or missing parameter for option: lod\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			argl += 2;
+		} else if (!strcmp(c, "views") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 2 >= args
+					|| sscanf(argv[argl + 2], "%d", &(config->numViews)) != 1
+					|| config->numViews < 1 || config->numViews > MAXVIEWS) {
+				printf("Invalid or missing parameter for option: views\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			argl += 2;
+		} else if (!strcmp(c, "interpolate") && !setxcol && !setycol
+				&& !setzcol && !settcol) {
+			if (argl + 2 >= args
+					|| sscanf(argv[argl + 2], "%d", &(config->interpolate)) != 1
+					|| config->interpolate < 0) {
+				printf("Invalid or missing parameter for option: interpolate\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			argl += 2;
+		} else if (!strcmp(c, "hermite") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			config->hermite = TRUE;
+			argl++;
+		} else if (!strcmp(c, "precision") && !setxcol && !setycol
+				&& !setzcol && !settcol) {
+			if (argl + 2 >= args
+					|| sscanf(argv[argl + 2], "%d", &(config->precision)) != 1
+					|| (config->precision != 64 && config->precision != 32
+							&& config->precision != 16)) {
+				printf("Invalid or missing parameter for option: precision\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			argl += 2;
+		} else if (!strcmp(c, "validate") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			config->validate = TRUE;
+			argl++;
 		} else if (!strcmp(c, "sleep") && !setxcol && !setycol && !setzcol
 				&& !settcol) {
 			control = sscanf(argv[argl + 2], "%lf", &tmp);
@@ -404,6 +595,42 @@ struct Configuration * handleArgs(int args, char **argv) {
 			}
 			config->tifjpg = FALSE;
 			argl += 2;
+		} else if (!strcmp(c, "y4mdump") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 2 >= args || strlen(argv[argl + 2]) >= 256) {
+				printf("Invalid or missing parameter for option: y4mdump\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			strcpy(config->videoname, argv[argl + 2]);
+			config->videodump = 1;
+			argl += 2;
+		} else if (!strcmp(c, "pipedump") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 2 >= args || strlen(argv[argl + 2]) >= 256) {
+				printf("Invalid or missing parameter for option: pipedump\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			strcpy(config->videoname, argv[argl + 2]);
+			config->videodump = 2;
+			argl += 2;
+		} else if (!strcmp(c, "tiledump") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 4 >= args || strlen(argv[argl + 2]) >= 50
+					|| sscanf(argv[argl + 3], "%d", &(config->exportWidth)) != 1
+					|| sscanf(argv[argl + 4], "%d", &(config->exportHeight)) != 1
+					|| config->exportWidth <= 2 * xborder
+					|| config->exportHeight <= 2 * yborder) {
+				printf("Invalid or missing parameter for option: tiledump\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			strcpy(config->exportname, argv[argl + 2]);
+			argl += 4;
 		} else if (!strcmp(c, "usetypes") && !setxcol && !setycol && !setzcol
 				&& !settcol) {
 			config->useTypesForColoring = TRUE;
@@ -420,6 +647,123 @@ struct Configuration * handleArgs(int args, char **argv) {
 				&& !settcol) {
 			config->oneLoop = TRUE;
 			argl++;
+		} else if (!strcmp(c, "persp") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 3 >= args
+					|| sscanf(argv[argl + 2], "%lf", &(config->perspFov)) != 1
+					|| sscanf(argv[argl + 3], "%lf", &(config->perspDist)) != 1
+					|| config->perspFov <= 0.0 || config->perspFov >= 180.0
+					|| config->perspDist <= 0.0) {
+				printf("Invalid or missing parameters for option: persp\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			argl += 3;
+		} else if (!strcmp(c, "depthcue") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			config->depthcue = TRUE;
+			argl++;
+		} else if (!strcmp(c, "slab") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 6 >= args
+					|| sscanf(argv[argl + 2], "%lf", &(config->slabNormal[0])) != 1
+					|| sscanf(argv[argl + 3], "%lf", &(config->slabNormal[1])) != 1
+					|| sscanf(argv[argl + 4], "%lf", &(config->slabNormal[2])) != 1
+					|| sscanf(argv[argl + 5], "%lf", &(config->slabMin)) != 1
+					|| sscanf(argv[argl + 6], "%lf", &(config->slabMax)) != 1
+					|| config->slabMin > config->slabMax) {
+				printf("Invalid or missing parameter for option: slab\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			tmp = sqrt(config->slabNormal[0] * config->slabNormal[0]
+					+ config->slabNormal[1] * config->slabNormal[1]
+					+ config->slabNormal[2] * config->slabNormal[2]);
+			if (tmp == 0.0) {
+				printf("The normal of the slab can't be zero.\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			config->slabNormal[0] /= tmp;
+			config->slabNormal[1] /= tmp;
+			config->slabNormal[2] /= tmp;
+			config->slab = TRUE;
+			argl += 6;
+		} else if (!strcmp(c, "trail") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 2 >= args
+					|| sscanf(argv[argl + 2], "%lf", &(config->trail)) != 1
+					|| config->trail < 0.0 || config->trail > 1.0) {
+				printf("Invalid or missing parameter for option: trail\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			argl += 2;
+		} else if (!strcmp(c, "bonds") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 2 >= args
+					|| sscanf(argv[argl + 2], "%lf", &(config->bondCutoff)) != 1
+					|| config->bondCutoff < 0.0) {
+				printf("Invalid or missing parameter for option: bonds\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			argl += 2;
+		} else if (!strcmp(c, "bond") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (config->numBondRules == MAXBONDRULES) {
+				printf("At most %d bond options can be given.\n", MAXBONDRULES);
+				return NULL;
+			}
+			if (argl + 4 >= args || strlen(argv[argl + 2]) > 4
+					|| strlen(argv[argl + 3]) > 4
+					|| sscanf(argv[argl + 4], "%lf",
+							&(config->bondRules[config->numBondRules].cutoff))
+							!= 1
+					|| config->bondRules[config->numBondRules].cutoff < 0.0) {
+				printf("Invalid or missing parameters for option: bond\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			strcpy(config->bondRules[config->numBondRules].type1, argv[argl + 2]);
+			strcpy(config->bondRules[config->numBondRules].type2, argv[argl + 3]);
+			config->numBondRules++;
+			argl += 4;
+		} else if (!strcmp(c, "pbc") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 4 >= args
+					|| sscanf(argv[argl + 2], "%d", &(config->pbc[0])) != 1
+					|| sscanf(argv[argl + 3], "%d", &(config->pbc[1])) != 1
+					|| sscanf(argv[argl + 4], "%d", &(config->pbc[2])) != 1
+					|| config->pbc[0] < 1 || config->pbc[1] < 1
+					|| config->pbc[2] < 1) {
+				printf("Invalid or missing parameters for option: pbc\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			if (config->pbc[0] * config->pbc[1] * config->pbc[2] > MAXIMAGES) {
+				printf("At most %d periodic images can be drawn.\n", MAXIMAGES);
+				return NULL;
+			}
+			argl += 4;
+		} else if (!strcmp(c, "camera") && !setxcol && !setycol && !setzcol
+				&& !settcol) {
+			if (argl + 2 >= args) {
+				printf("Invalid or missing parameter for option: camera\n");
+				printf(
+						"Use option 'help' for list of all valid command line parameters\n");
+				return NULL;
+			}
+			if (!readCameraPath(config, argv[argl + 2]))
+				return NULL;
+			argl += 2;
 		} else if (!strcmp(c, "rotate") && !setxcol && !setycol && !setzcol
 				&& !settcol) {
 			sscanf(argv[argl + 2], "%lf", &config->initIangle);
@@ -464,6 +808,12 @@ struct Configuration * handleArgs(int args, char **argv) {
 
 	if (!config->inputFormatXYZ)
 		config->useTypesForColoring = FALSE;
+	if (config->batch && config->dumpname[0] == '\0' && !config->videodump
+			&& config->exportname[0] == '\0') {
+		printf(
+				"The batch option needs pngdump, jpgdump, tiledump, y4mdump or pipedump.\n");
+		return NULL;
+	}
 	if (setxcol && setycol && setzcol && settcol && setfile)
 		return config;
 	else {
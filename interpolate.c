@@ -0,0 +1,146 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include "parameters.h"
+
+/************************************************************************/
+/* Called by the owner when it moves on from previousFrame to the next	*/
+/* frame. The frames the steps in between are interpolated from are	*/
+/* kept from the reader, the others are handed back to it.		*/
+/************************************************************************/
+void passFrame(struct Context *context, struct Frame *previousFrame) {
+	struct Configuration *config;
+
+	config = context->config;
+
+	/* The frame read before the one interpolated from is only needed
+	 for the cubic steps. */
+	if (context->interpBefore != NULL)
+		g_mutex_unlock(context->interpBefore->framecomplete);
+	context->interpBefore = NULL;
+	if (config->interpolate > 0 && config->hermite)
+		context->interpBefore = context->interpFrom;
+	else if (context->interpFrom != NULL)
+		g_mutex_unlock(context->interpFrom->framecomplete);
+	context->interpFrom = NULL;
+
+	if (previousFrame != NULL && config->interpolate > 0) {
+		context->interpFrom = previousFrame;
+		context->interpStep = 1;
+	} else {
+		if (previousFrame != NULL)
+			g_mutex_unlock(previousFrame->framecomplete);
+		context->interpStep = config->interpolate + 1;
+	}
+}
+
+/************************************************************************/
+/* Returns TRUE while there are steps left to draw between the frame	*/
+/* read before and the current frame, the next one is then drawn by	*/
+/* increasing interpStep.						*/
+/************************************************************************/
+gboolean betweenFrames(struct Context *context) {
+	return context->interpFrom != NULL
+			&& context->interpStep <= context->config->interpolate;
+}
+
+/************************************************************************/
+/* Returns the frame the current frame of the view is interpolated from	*/
+/* at this step, or NULL if it is drawn as read. The atoms are matched	*/
+/* by index, so only frames with as many atoms are used. The position	*/
+/* of each atom is then w[0] * before + w[1] * from + w[2] * current,	*/
+/* where before is the frame read before from, or NULL if it is not	*/
+/* used.								*/
+/************************************************************************/
+struct Frame * getInterpolation(struct Context *context, struct Frame **before,
+		double *w) {
+	struct Context *owner;
+	struct Frame *frame, *from;
+	double t, t2, t3, h00, h10, h01, h11;
+
+	owner = context->owner;
+	frame = context->currentFrame;
+	from = owner->interpFrom;
+	*before = NULL;
+	if (!betweenFrames(owner) || from->numAtoms != frame->numAtoms)
+		return NULL;
+
+	t = (double) owner->interpStep / (owner->config->interpolate + 1);
+	w[0] = 0.0;
+	w[1] = 1.0 - t;
+	w[2] = t;
+
+	/* The cubic Hermite curve uses the central difference as the tangent
+	 at from and the second order backward difference at the current
+	 frame, so only frames already read are needed and atoms moving
+	 with a constant acceleration follow their path exactly. */
+	if (owner->interpBefore != NULL
+			&& owner->interpBefore->numAtoms == frame->numAtoms) {
+		*before = owner->interpBefore;
+		t2 = t * t;
+		t3 = t2 * t;
+		h00 = 2.0 * t3 - 3.0 * t2 + 1.0;
+		h10 = t3 - 2.0 * t2 + t;
+		h01 = -2.0 * t3 + 3.0 * t2;
+		h11 = t3 - t2;
+		w[0] = 0.5 * (h11 - h10);
+		w[1] = h00 - 2.0 * h11;
+		w[2] = 0.5 * h10 + h01 + 1.5 * h11;
+	}
+	return from;
+}
+
+/************************************************************************/
+/* Returns the number of the frame drawn, counting the steps between	*/
+/* the frames read as frames of their own.				*/
+/************************************************************************/
+gint getShownFrameNumber(struct Context *context) {
+	struct Context *owner;
+	gint steps;
+
+	owner = context->owner;
+	steps = owner->config->interpolate + 1;
+	return context->currentFrame->numframe * steps + owner->interpStep - steps;
+}
+
+/************************************************************************/
+/* Returns the time of the frame drawn, between the times of the frames	*/
+/* read when a step between them is drawn.				*/
+/************************************************************************/
+double getShownFrameTime(struct Context *context) {
+	struct Context *owner;
+	struct Frame *frame;
+	double t;
+
+	owner = context->owner;
+	frame = context->currentFrame;
+	if (!betweenFrames(owner))
+		return frame->atime;
+
+	t = (double) owner->interpStep / (owner->config->interpolate + 1);
+	return owner->interpFrom->atime + t * (frame->atime - owner->interpFrom->atime);
+}
@@ -107,13 +107,22 @@ void restartAnimation(GtkWidget *widget, struct Context *context) {
 	}
 
 	context->nextFrameNum = NumFrameRI;
+	context->dumpPending = FALSE;
+	context->interpFrom = NULL;
+	context->interpBefore = NULL;
 
 	for (i = 0; i < NUMFRAMES; i++) {
 		g_mutex_unlock(context->framedata[i].framecomplete);
 		g_mutex_unlock(context->framedata[i].framedrawn);
 	}
 
-	context->currentFrame = NULL;
+	for (i = 0; i < context->numViews; i++) {
+		context->views[i]->currentFrame = NULL;
+		context->views[i]->drawnFrame = NULL;
+		context->views[i]->trail.frame = NULL;
+		context->views[i]->dumpTrail.frame = NULL;
+		context->views[i]->transform.frame = NULL;
+	}
 }
 
 /************************************************************************/
@@ -122,7 +131,7 @@ void restartAnimation(GtkWidget *widget, struct Context *context) {
 /************************************************************************/
 void setupButtonPressed(GtkWidget *widget, struct Context *context) {
 	context->setupstop = TRUE;
-	showSetupWindow(context);
+	showSetupWindow(context->activeView);
 }
 
 /************************************************************************/
@@ -132,6 +141,9 @@ gboolean updateImageArea(GtkWidget *widget, cairo_t *cr,
 	guint width, height;
 	cairo_t *first_cr;
 	cairo_surface_t *first;
+	struct DrawBuffers *buffers;
+	gboolean preview;
+	double xc, yc, zc;
 	char tstr[256];
 
 	width = gtk_widget_get_allocated_width(widget);
@@ -139,48 +151,79 @@ gboolean updateImageArea(GtkWidget *widget, cairo_t *cr,
 
 	if (context->currentFrame != NULL) {
 		if (g_mutex_trylock((context->currentFrame)->framedrawn) == TRUE) {
-			first = cairo_surface_create_similar(cairo_get_target(cr),
-					CAIRO_CONTENT_COLOR, width, height);
+			/* The surface is kept until the window changes size. */
+			buffers = &(context->buffers);
+			if (buffers->window == NULL || buffers->windowWidth != width
+					|| buffers->windowHeight != height) {
+				if (buffers->window != NULL)
+					cairo_surface_destroy(buffers->window);
+				buffers->window = cairo_surface_create_similar(
+						cairo_get_target(cr), CAIRO_CONTENT_COLOR, width, height);
+				buffers->windowWidth = width;
+				buffers->windowHeight = height;
+			}
+			first = buffers->window;
 
 			first_cr = cairo_create(first);
 
 			context->crXSize = width;
 			context->crYSize = height;
 
-			drawFrame(context, first_cr);
+			/* Only a preview is drawn while the scene is rotated with the
+			 mouse, the whole frame is drawn again when it is released. */
+			preview = context->pressed && context->config->lod > 0;
+			context->preview = preview;
+			context->picking = TRUE;
+			drawFrame(context, first_cr, &(context->trail));
+			context->picking = FALSE;
+			context->preview = FALSE;
+
+			/* The dump is copied from the window if it has the size of
+			 the dumped images and the whole frame was drawn on it. */
+			if (context->dumpPending) {
+				context->dumpPending = FALSE;
+				cairo_surface_flush(first);
+				dumpFrame(context, !preview
+						&& width == context->config->absxsize + 2 * xborder
+						&& height == context->config->absysize + 2 * yborder ?
+						first : NULL);
+			}
+			context->drawnFrame = context->currentFrame;
 
 			cairo_set_source_surface(cr, first, 0, 0);
 			cairo_paint(cr);
 
-			cairo_surface_destroy(first);
-
 			cairo_destroy(first_cr);
 
-			sprintf(tstr, "X: %4.3f - %4.3f",
-					(context->currentFrame)->xmin,
-					(context->currentFrame)->xmax);
-			gtk_entry_set_text((GtkEntry *) maxx_entry, tstr);
-			sprintf(tstr, "Y: %4.3f - %4.3f",
-					(context->currentFrame)->ymin,
-					(context->currentFrame)->ymax);
-			gtk_entry_set_text((GtkEntry *) maxy_entry, tstr);
-			sprintf(tstr, "Z: %4.3f - %4.3f",
-					(context->currentFrame)->zmin,
-					(context->currentFrame)->zmax);
-			gtk_entry_set_text((GtkEntry *) maxz_entry, tstr);
-
-			sprintf(tstr, "Time: %5.3f fs", (context->currentFrame)->atime);
-			gtk_entry_set_text((GtkEntry *) time_entry, tstr);
+			/* The entries show the view the buttons change. */
+			if (context == context->owner->activeView) {
+				sprintf(tstr, "X: %4.3f - %4.3f",
+						context->transform.extent.xmin,
+						context->transform.extent.xmax);
+				gtk_entry_set_text((GtkEntry *) maxx_entry, tstr);
+				sprintf(tstr, "Y: %4.3f - %4.3f",
+						context->transform.extent.ymin,
+						context->transform.extent.ymax);
+				gtk_entry_set_text((GtkEntry *) maxy_entry, tstr);
+				sprintf(tstr, "Z: %4.3f - %4.3f",
+						context->transform.extent.zmin,
+						context->transform.extent.zmax);
+				gtk_entry_set_text((GtkEntry *) maxz_entry, tstr);
+
+				sprintf(tstr, "Time: %5.3f fs", getShownFrameTime(context));
+				gtk_entry_set_text((GtkEntry *) time_entry, tstr);
+
+				getViewAngles(context, &xc, &yc, &zc);
+				sprintf(tstr, "X angle: %f", xc);
+				gtk_entry_set_text((GtkEntry *) xc_entry, tstr);
+				sprintf(tstr, "Y angle: %f", yc);
+				gtk_entry_set_text((GtkEntry *) yc_entry, tstr);
+				sprintf(tstr, "Z angle: %f", zc);
+				gtk_entry_set_text((GtkEntry *) zc_entry, tstr);
+			}
 
 			g_mutex_unlock((context->currentFrame)->framedrawn);
 
-			sprintf(tstr, "X angle: %f", context->config->xc);
-			gtk_entry_set_text((GtkEntry *) xc_entry, tstr);
-			sprintf(tstr, "Y angle: %f", context->config->yc);
-			gtk_entry_set_text((GtkEntry *) yc_entry, tstr);
-			sprintf(tstr, "Z angle: %f", context->config->zc);
-			gtk_entry_set_text((GtkEntry *) zc_entry, tstr);
-
 		}
 	}
 
@@ -209,11 +252,28 @@ gboolean keyPressEvent(GtkWidget *widget, GdkEventKey *event, struct Context *co
 	return TRUE;
 }
 
+/************************************************************************/
+/* Writes the number, type and coordinates of a picked atom in str.	*/
+/************************************************************************/
+static void describeAtom(struct Frame *frame, struct Atom *atom, char *str) {
+	gint index;
+
+	index = atom - frame->atomdata;
+	if (atom->atype >= 0 && atom->atype < frame->numTypes)
+		sprintf(str, "Atom %d (%s): %5.3f %5.3f %5.3f", index,
+				frame->types[atom->atype], atom->xcoord, atom->ycoord,
+				atom->zcoord);
+	else
+		sprintf(str, "Atom %d: %5.3f %5.3f %5.3f", index, atom->xcoord,
+				atom->ycoord, atom->zcoord);
+}
+
 /************************************************************************/
 /* This procedure is called when a mousebutton is pressed.		*/
 /* If the right button is pressed it quits, to be backwards compatible	*/
 /* with dpc. When the left button is pressed this procedure saves the	*/
 /* position of the cursor.						*/
+/* The view clicked becomes the one the buttons and setup change.	*/
 /************************************************************************/
 gint buttonPressEvent(GtkWidget *widget, GdkEventButton *event,
 		struct Context *context) {
@@ -225,8 +285,12 @@ gint buttonPressEvent(GtkWidget *widget, GdkEventButton *event,
 		context->pressed = TRUE;
 		context->xpress = event->x;
 		context->ypress = event->y;
+		if (context->owner->activeView != context) {
+			context->owner->activeView = context;
+			triggerImageRedraw(widget, context);
+		}
 	} else if (event->button == 2) {
-		context->pausedGotoNextFrame = TRUE;
+		context->owner->pausedGotoNextFrame = TRUE;
 	} else if (event->button == 3) {
 		gtk_main_quit();
 	}
@@ -257,7 +321,8 @@ gint buttonReleaseEvent(GtkWidget *widget, GdkEventButton *event,
 
 /************************************************************************/
 /* This function is called when the mouse is moved inside the window,	*/
-/* it sets the coordinates in the coordinateentry. It also rotates the	*/
+/* it sets the coordinates, or the atom under the pointer, in the	*/
+/* coordinateentry. It also rotates the					*/
 /* atoms according to the movement of the mouse while the left button	*/
 /* is pressed down.							*/
 /************************************************************************/
@@ -266,7 +331,8 @@ gint motionNotifyEvent(GtkWidget *widget, GdkEventMotion *event,
 	gint x, y;
 	char xstr[256];
 	GdkModifierType state;
-	gint NumFrame;
+	struct Atom *atom;
+	struct Extent *extent;
 
 #if Debug
 	printf("Fetching coordinates of pointer.\n");
@@ -289,26 +355,26 @@ gint motionNotifyEvent(GtkWidget *widget, GdkEventMotion *event,
 		}
 	}
 
-	NumFrame = context->nextFrameNum;
-	NumFrame--;
-	if (NumFrame < 0)
-		NumFrame += NUMFRAMES;
-
 #if Debug
 	printf("Fetching and setting coordinates of pointer at scene.\n");
 #endif
+	/* The coordinates are those of the view as it was drawn last. */
+	extent = &(context->pick.extent);
 	sprintf(
 			xstr,
 			"X: %5.3f   Y: %5.3f",
-			(((context->framedata[NumFrame].xmax
-					- context->framedata[NumFrame].xmin) * (x - xborder)
+			(((extent->xmax - extent->xmin) * (x - xborder)
 					/ (double) context->config->absxsize)
-					+ context->framedata[NumFrame].xmin),
-			(((context->framedata[NumFrame].ymax
-					- context->framedata[NumFrame].ymin)
+					+ extent->xmin),
+			(((extent->ymax - extent->ymin)
 					* (context->config->absysize - (y - yborder))
 					/ (double) context->config->absysize))
-					+ context->framedata[NumFrame].ymin);
+					+ extent->ymin);
+
+	/* The atom under the pointer is looked up from the last drawing. */
+	atom = findPickedAtom(context, x, y);
+	if (atom != NULL)
+		describeAtom(context->currentFrame, atom, xstr);
 	gtk_entry_set_text((GtkEntry *) coord_entry, xstr);
 
 	return TRUE;
@@ -332,9 +398,13 @@ void setContextConfig(struct Context *context, struct Configuration *newconfig)
 /************************************************************************/
 /* This function is called at the end of setupwindow if the ok button 	*/
 /* was pressed, it reinitializes gdpc if necessary and then continous	*/
-/* the animation.							*/
+/* the animation. The input is read with the columns of the first view,	*/
+/* so new columns or a new file from another view are passed to it.	*/
 /************************************************************************/
 void setupStartOk(struct Context *context, struct Configuration *newconfig) {
+	struct Context *owner;
+
+	owner = context->owner;
 
 	if (context->config->absxsize != newconfig->absxsize
 			|| context->config->absysize != newconfig->absysize) {
@@ -345,22 +415,30 @@ void setupStartOk(struct Context *context, struct Configuration *newconfig) {
 	if (context->config->xcolumn != newconfig->xcolumn || context->config->ycolumn != newconfig->ycolumn
 			|| context->config->zcolumn != newconfig->zcolumn
 			|| context->config->tcolumn != newconfig->tcolumn) {
-		fseek(context->fp, SEEK_SET, 0);
-		g_mutex_unlock(context->atEnd);
+		if (owner != context) {
+			owner->config->xcolumn = newconfig->xcolumn;
+			owner->config->ycolumn = newconfig->ycolumn;
+			owner->config->zcolumn = newconfig->zcolumn;
+			owner->config->tcolumn = newconfig->tcolumn;
+		}
+		fseek(owner->fp, SEEK_SET, 0);
+		g_mutex_unlock(owner->atEnd);
 	}
 	if (strlen(newconfig->file) > 0) {
-		fclose(context->fp);
-		context->fp = fopen(newconfig->file, "r");
-		if (context->fp == NULL) {
+		if (owner != context)
+			strcpy(owner->config->file, newconfig->file);
+		fclose(owner->fp);
+		owner->fp = fopen(newconfig->file, "r");
+		if (owner->fp == NULL) {
 			printf("Error opening file: %s\n", newconfig->file);
 			gtk_main_quit();
 		}
-		fseek(context->fp, 0, 0);
-		g_mutex_unlock(context->atEnd);
+		fseek(owner->fp, 0, 0);
+		g_mutex_unlock(owner->atEnd);
 	}
 	setContextConfig(context, newconfig);
 
-	context->setupstop = FALSE;
+	owner->setupstop = FALSE;
 }
 
 /************************************************************************/
@@ -368,7 +446,7 @@ void setupStartOk(struct Context *context, struct Configuration *newconfig) {
 /* was pressed. It simply continous the animation.						*/
 /************************************************************************/
 void setupStartCancel(struct Context *context) {
-	context->setupstop = FALSE;
+	context->owner->setupstop = FALSE;
 }
 
 /************************************************************************/
@@ -396,6 +474,62 @@ void triggerImageRedraw(GtkWidget *widget, struct Context *params) {
 	gtk_widget_queue_draw(params->drawing_area);
 }
 
+/************************************************************************/
+/* Returns TRUE when every view that can be drawn has drawn the current	*/
+/* frame, so that it can be handed back to the reader.			*/
+/************************************************************************/
+static gboolean viewsHaveDrawn(struct Context *context) {
+	gint i;
+	struct Context *view;
+
+	for (i = 0; i < context->numViews; i++) {
+		view = context->views[i];
+		if (view->drawnFrame != context->currentFrame
+				&& gtk_widget_is_drawable(view->drawing_area))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/************************************************************************/
+/* Dumps the frame shown last if the window was never drawn with it,	*/
+/* as when it was hidden, before the next frame is shown.		*/
+/************************************************************************/
+static void flushDump(struct Context *context) {
+	if (context->dumpPending) {
+		context->dumpPending = FALSE;
+		dumpFrame(context, NULL);
+	}
+}
+
+/************************************************************************/
+/* Has every view draw the current frame, or the step between frames,	*/
+/* and dumps it if images or a video are made. The first view dumps	*/
+/* the frame when it has drawn it, so it isn't drawn twice.		*/
+/************************************************************************/
+static void showFrame(struct Context *context) {
+	gint i;
+
+	/* All views draw the same frame. */
+	for (i = 0; i < context->numViews; i++) {
+		context->views[i]->currentFrame = context->currentFrame;
+		context->views[i]->drawnFrame = NULL;
+		gtk_widget_queue_draw(context->views[i]->drawing_area);
+	}
+
+#if Debug
+	printf("%s\n",context->config->dumpname);
+#endif
+	if (context->config->dumpname[0] != '\0'
+			|| context->config->videodump
+			|| context->config->exportname[0] != '\0') {
+		if (gtk_widget_is_drawable(context->drawing_area))
+			context->dumpPending = TRUE;
+		else
+			dumpFrame(context, NULL);
+	}
+}
+
 /************************************************************************/
 /* This function is the callback for the timeout instruction.		*/
 /* It checks if a frame is being drawed or pause is pressed or if the	*/
@@ -404,8 +538,6 @@ void triggerImageRedraw(GtkWidget *widget, struct Context *params) {
 /* timeentry and puts the pixmap onto the screen.			*/
 /************************************************************************/
 gboolean switchToNextFrame(struct Context *context) {
-	char picname[128];
-	char pictype[16];
 	struct timeval tv;
 	struct timezone tz;
 	static long previous_usec = 0;
@@ -425,6 +557,17 @@ gboolean switchToNextFrame(struct Context *context) {
 				&& (!context->config->waitForNextFramePress || context->pausedGotoNextFrame)) {
 			context->pausedGotoNextFrame = FALSE;
 
+			/* The steps between two frames are drawn before the next
+			 frame is taken. */
+			if (betweenFrames(context)) {
+				if (viewsHaveDrawn(context)) {
+					flushDump(context);
+					context->interpStep++;
+					showFrame(context);
+				}
+				return TRUE;
+			}
+
 			if (context->config->oneLoop) {
 				if (context->currentFrame != NULL) {
 					if ((context->currentFrame)->lastFrame) {
@@ -435,7 +578,8 @@ gboolean switchToNextFrame(struct Context *context) {
 
 			previousDrawn = FALSE;
 			if (context->currentFrame != NULL) {
-				if (!(context->currentFrame)->lastFrame) {
+				if (!(context->currentFrame)->lastFrame
+						&& viewsHaveDrawn(context)) {
 					if (g_mutex_trylock((context->currentFrame)->framedrawn)
 							== TRUE) {
 						previousDrawn = TRUE;
@@ -449,54 +593,20 @@ gboolean switchToNextFrame(struct Context *context) {
 			if (g_mutex_trylock(context->framedata[context->nextFrameNum].frameready)
 					== TRUE && previousDrawn) {
 
+				flushDump(context);
 				previousFrame = context->currentFrame;
 				context->currentFrame = &(context->framedata[context->nextFrameNum]);
 
-				gtk_widget_queue_draw(context->drawing_area);
-
-				if (previousFrame != NULL) {
+				if (previousFrame != NULL)
 					g_mutex_unlock(previousFrame->framedrawn);
-					g_mutex_unlock(previousFrame->framecomplete);
-				}
+				passFrame(context, previousFrame);
 
 				context->nextFrameNum++;
 				if (context->nextFrameNum == NUMFRAMES) {
 					context->nextFrameNum = 0;
 				}
 
-#if Debug
-				printf("%s\n",context->dumpname);
-#endif
-				if (context->config->dumpname[0] != '\0') {
-#if Debug
-					printf("Creating image of frame to dump.\n");
-#endif
-
-					if (context->config->tifjpg) {
-#if Debug
-						printf("Dumping png.\n");
-#endif
-						sprintf(pictype, "png");
-						if (context->config->dumpnum)
-							sprintf(picname, "%s-%d.png", context->config->dumpname,
-									context->currentFrame->numframe);
-						else
-							sprintf(picname, "%s-%5.3f.png", context->config->dumpname,
-									context->currentFrame->atime);
-					} else {
-#if Debug
-						printf("Dumping jpg.\n");
-#endif
-						sprintf(pictype, "jpeg");
-						if (context->config->dumpnum)
-							sprintf(picname, "%s-%d.jpg", context->config->dumpname,
-									context->currentFrame->numframe);
-						else
-							sprintf(picname, "%s-%5.3f.jpg", context->config->dumpname,
-									context->currentFrame->atime);
-					}
-				}
-				context->currentFrame->numframe++;
+				showFrame(context);
 			}
 		}
 	}
@@ -504,6 +614,38 @@ gboolean switchToNextFrame(struct Context *context) {
 	return TRUE;
 }
 
+/************************************************************************/
+/* Creates the drawing area of a view and connects its events.		*/
+/************************************************************************/
+static GtkWidget * getViewArea(struct Context *view) {
+	GtkWidget *drawing_area;
+
+	drawing_area = gtk_drawing_area_new();
+	gtk_widget_set_size_request(drawing_area, view->config->absxsize + 2 * xborder,
+			view->config->absysize + 2 * yborder);
+
+	view->drawing_area = drawing_area;
+
+	/* Connect the events to their procedures. */
+	g_signal_connect(G_OBJECT (drawing_area), "draw",
+			G_CALLBACK (updateImageArea), view);
+
+	g_signal_connect(G_OBJECT (drawing_area), "button_press_event",
+			G_CALLBACK (buttonPressEvent), view);
+	g_signal_connect(G_OBJECT (drawing_area), "button_release_event",
+			G_CALLBACK (buttonReleaseEvent), view);
+
+	g_signal_connect(G_OBJECT (drawing_area), "motion_notify_event",
+			G_CALLBACK (motionNotifyEvent), view);
+
+	gtk_widget_set_events(
+			drawing_area,
+			GDK_EXPOSURE_MASK | GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK
+					| GDK_POINTER_MOTION_MASK | GDK_POINTER_MOTION_HINT_MASK);
+
+	return drawing_area;
+}
+
 /************************************************************************/
 /************************************************************************/
 GtkWidget * getMainWindow(struct Context *context) {
@@ -514,8 +656,9 @@ GtkWidget * getMainWindow(struct Context *context) {
 	GtkWidget *xminus_button, *yminus_button, *zminus_button, *xplus10_button;
 	GtkWidget *yplus10_button, *zplus10_button, *xminus10_button;
 	GtkWidget *yminus10_button, *zminus10_button, *xlabel, *ylabel, *zlabel;
-	GtkWidget *drawing_area;
+	GtkWidget *hboxviews;
 	GtkWidget *window;
+	gint i;
 
 	struct AngleAdjustment *angleAdjustment;
 
@@ -550,32 +693,12 @@ GtkWidget * getMainWindow(struct Context *context) {
 	ylabel = gtk_label_new(" Y ");
 	zlabel = gtk_label_new(" Z ");
 
-	/* Create the drawing area. */
-
-	drawing_area = gtk_drawing_area_new();
-	gtk_widget_set_size_request(drawing_area, context->config->absxsize + 2 * xborder,
-			context->config->absysize + 2 * yborder);
-
-	context->drawing_area = drawing_area;
-
-	gtk_box_pack_start(GTK_BOX (vbox), drawing_area, TRUE, TRUE, 0);
-
-	/* Connect the events to their procedures. */
-	g_signal_connect(G_OBJECT (drawing_area), "draw",
-			G_CALLBACK (updateImageArea), context);
-
-	g_signal_connect(G_OBJECT (drawing_area), "button_press_event",
-			G_CALLBACK (buttonPressEvent), context);
-	g_signal_connect(G_OBJECT (drawing_area), "button_release_event",
-			G_CALLBACK (buttonReleaseEvent), context);
-
-	g_signal_connect(G_OBJECT (drawing_area), "motion_notify_event",
-			G_CALLBACK (motionNotifyEvent), context);
-
-	gtk_widget_set_events(
-			drawing_area,
-			GDK_EXPOSURE_MASK | GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK
-					| GDK_POINTER_MOTION_MASK | GDK_POINTER_MOTION_HINT_MASK);
+	/* Create the drawing areas of the views side by side. */
+	hboxviews = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+	for (i = 0; i < context->numViews; i++)
+		gtk_box_pack_start(GTK_BOX (hboxviews),
+				getViewArea(context->views[i]), TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX (vbox), hboxviews, TRUE, TRUE, 0);
 
 	/* Create entries for the  x- and y- coordinates of the cursor and the time. */
 	maxx_entry = gtk_entry_new();
@@ -778,18 +901,14 @@ GtkWidget * getMainWindow(struct Context *context) {
 }
 
 /************************************************************************/
-/* The StartEverything function is called by main() after the 		*/
-/* commandline arguments or the setupwindow has finished processing of 	*/
-/* the parameters. This function sets up all the buttons, entries, 	*/
-/* boxes,the timeout and the drawingboard.				*/
+/* Opens the input file, initializes the frame semaphores and starts	*/
+/* the thread reading the input. Returns FALSE if the input file can't	*/
+/* be opened.								*/
 /************************************************************************/
-void StartEverything(struct Context *context) {
-	GtkWidget *window;
+gboolean startReading(struct Context *context) {
 	gint i;
 	GThread *th_a; /* Thread structure */
 
-	context->StartedAlready = TRUE;
-
 	/* Open the input file, if it fails exit. */
 	if (context->config->file[0] == '_')
 		context->fp = stdin;
@@ -798,7 +917,7 @@ void StartEverything(struct Context *context) {
 		context->fp = fopen(context->config->file, "r");
 		if (context->fp == NULL) {
 			printf("Error opening file: %s\n", context->config->file);
-			gtk_main_quit();
+			return FALSE;
 		}
 		fseek(context->fp, 0, 0);
 	}
@@ -811,6 +930,14 @@ void StartEverything(struct Context *context) {
 		context->framedata[i].framedrawn = g_mutex_new();
 		g_mutex_unlock(context->framedata[i].framedrawn);
 		context->framedata[i].atomdata = NULL;
+		context->framedata[i].numBonded = 0;
+		context->framedata[i].bondStart = NULL;
+		context->framedata[i].bondPartner = NULL;
+		context->framedata[i].bondStartAlloc = 0;
+		context->framedata[i].bondPartnerAlloc = 0;
+		context->framedata[i].packing = 0;
+		context->framedata[i].packed = NULL;
+		context->framedata[i].packedAlloc = 0;
 	}
 
 	context->filewait = g_mutex_new();
@@ -821,7 +948,37 @@ void StartEverything(struct Context *context) {
 			g_thread_create ((GThreadFunc) readInput, (gpointer) context, TRUE, NULL);
 	if (th_a == NULL) {
 		fprintf(stderr, "Creating read thread failed.\n");
-		gtk_main_quit();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/************************************************************************/
+/* The StartEverything function is called by main() after the 		*/
+/* commandline arguments or the setupwindow has finished processing of 	*/
+/* the parameters. This function sets up all the buttons, entries, 	*/
+/* boxes,the timeout and the drawingboard. It returns FALSE if the	*/
+/* input can't be read.							*/
+/************************************************************************/
+gboolean StartEverything(struct Context *context) {
+	GtkWidget *window;
+	struct Context *view;
+	gint i;
+
+	context->StartedAlready = TRUE;
+
+	if (!startReading(context))
+		return FALSE;
+
+	/* The other views get their own settings and orientation, but draw
+	 the frames read by this context. */
+	context->numViews = context->config->numViews;
+	for (i = 1; i < context->numViews; i++) {
+		view = getNewContext();
+		view->owner = context;
+		view->StartedAlready = TRUE;
+		setContextConfig(view, copyConfiguration(context->config));
+		context->views[i] = view;
 	}
 
 	window = getMainWindow(context);
@@ -829,6 +986,61 @@ void StartEverything(struct Context *context) {
 
 	/* Setup timeout. */
 	g_idle_add((GSourceFunc) switchToNextFrame, context);
+	return TRUE;
+}
+
+/************************************************************************/
+/* This function is called by main() instead of StartEverything when	*/
+/* the batch option is given. It reads the input and dumps an image of	*/
+/* every frame as fast as possible, without opening any windows. It	*/
+/* returns FALSE if the input can't be read.				*/
+/************************************************************************/
+gboolean runBatch(struct Context *context) {
+	struct Frame *nextFrame, *previousFrame;
+	gint numDumped;
+
+	context->StartedAlready = TRUE;
+
+	if (!startReading(context))
+		return FALSE;
+
+	numDumped = 0;
+	while (TRUE) {
+		nextFrame = &(context->framedata[context->nextFrameNum]);
+
+		/* The xyz reader only notices the end of the file after the last
+		 frame has been handed over, so keep checking while waiting. */
+		while (g_mutex_trylock(nextFrame->frameready) == FALSE) {
+			if (context->currentFrame != NULL
+					&& (context->currentFrame)->lastFrame)
+				break;
+			g_usleep(1000);
+		}
+		if (context->currentFrame != NULL && (context->currentFrame)->lastFrame)
+			break;
+
+		previousFrame = context->currentFrame;
+		context->currentFrame = nextFrame;
+		passFrame(context, previousFrame);
+
+		context->nextFrameNum++;
+		if (context->nextFrameNum == NUMFRAMES) {
+			context->nextFrameNum = 0;
+		}
+
+		dumpFrame(context, NULL);
+		numDumped++;
+
+		while (betweenFrames(context)) {
+			context->interpStep++;
+			dumpFrame(context, NULL);
+			numDumped++;
+		}
+	}
+
+	finishEncoders();
+	printf("Dumped %d frames.\n", numDumped);
+	return TRUE;
 }
 
 /************************************************************************/
@@ -861,10 +1073,6 @@ struct Configuration * getNewConfiguration() {
 		config->ymax = 0.0;
 		config->zmax = 0.0;
 
-		config->xc = 0.0;
-		config->yc = 0.0;
-		config->zc = 0.0;
-
 		config->file[0] = '\0';
 
 		config->vary = DEFAULT_VARY;
@@ -880,6 +1088,10 @@ struct Configuration * getNewConfiguration() {
 		config->waitForNextFramePress = FALSE;
 		config->oneLoop = FALSE;
 		config->useTypesForColoring = FALSE;
+		config->zbuffer = DEFAULT_ZBUFFER;
+		config->density = DEFAULT_DENSITY;
+		config->cull = DEFAULT_CULL;
+		config->batch = FALSE;
 
 		config->xcolumn = DEFAULT_XCOLUMN;
 		config->ycolumn = DEFAULT_YCOLUMN;
@@ -889,6 +1101,35 @@ struct Configuration * getNewConfiguration() {
 		config->interval = DEFAULT_INTERVAL;
 
 		config->dumpname[0] = DEFAULT_DUMPNAME;
+		config->videodump = DEFAULT_VIDEODUMP;
+		config->exportname[0] = DEFAULT_DUMPNAME;
+		config->exportWidth = 0;
+		config->exportHeight = 0;
+		config->tileTop = 0;
+		config->tileRows = 0;
+		config->lod = DEFAULT_LOD;
+		config->numViews = DEFAULT_VIEWS;
+		config->interpolate = DEFAULT_INTERPOLATE;
+		config->hermite = DEFAULT_HERMITE;
+		config->precision = DEFAULT_PRECISION;
+		config->validate = DEFAULT_VALIDATE;
+		config->bondCutoff = DEFAULT_BONDCUTOFF;
+		config->numBondRules = 0;
+		config->numCameraKeys = 0;
+		config->perspFov = DEFAULT_PERSPFOV;
+		config->perspDist = DEFAULT_PERSPDIST;
+		config->depthcue = DEFAULT_DEPTHCUE;
+		config->trail = DEFAULT_TRAIL;
+		config->slab = DEFAULT_SLAB;
+		config->slabNormal[0] = 0.0;
+		config->slabNormal[1] = 0.0;
+		config->slabNormal[2] = 1.0;
+		config->slabMin = 0.0;
+		config->slabMax = 0.0;
+		config->pbc[0] = DEFAULT_PBC;
+		config->pbc[1] = DEFAULT_PBC;
+		config->pbc[2] = DEFAULT_PBC;
+		config->videoname[0] = '\0';
 
 		strcpy(config->timedelim, TIMESTRING);
 	}
@@ -912,6 +1153,31 @@ struct Context * getNewContext() {
 		context->pausecheck = FALSE;
 		context->setupstop = FALSE;
 		context->pressed = FALSE;
+		context->preview = FALSE;
+		context->atomDrawTime = 0.0;
+		context->picking = FALSE;
+		context->pick.atoms = NULL;
+		context->pick.alloc = 0;
+		context->pick.frame = NULL;
+		memset(&(context->pick.extent), 0, sizeof(struct Extent));
+		context->images.num = 1;
+		resetOrientation(context);
+		memset(&(context->slab), 0, sizeof(struct SlabIndex));
+		context->transform.frame = NULL;
+		memset(&(context->transform.atoms), 0, sizeof(struct Scratch));
+		memset(&(context->transform.check), 0, sizeof(struct Scratch));
+		memset(&(context->buffers), 0, sizeof(struct DrawBuffers));
+		memset(&(context->trail), 0, sizeof(struct Trail));
+		memset(&(context->dumpTrail), 0, sizeof(struct Trail));
+		context->interpFrom = NULL;
+		context->interpBefore = NULL;
+		context->interpStep = 1;
+		context->owner = context;
+		context->views[0] = context;
+		context->numViews = 1;
+		context->activeView = context;
+		context->drawnFrame = NULL;
+		context->dumpPending = FALSE;
 		context->StartedAlready = FALSE;
 		context->nextFrameNum = 0;
 		context->currentFrame = NULL;
@@ -928,18 +1194,26 @@ struct Context * getNewContext() {
 int main(int argc, char **argv) {
 	struct Context *context;
 	struct Configuration *config;
+	gboolean haveDisplay;
 
-	/* Start gtk initialization. */
-	gtk_init(&argc, &argv);
+	/* Start gtk initialization, a display is only needed if the windows
+	 are shown. */
+	haveDisplay = gtk_init_check(&argc, &argv);
 
 	g_thread_init(NULL);
 
+	initWorkers();
+
 	printf(DISCLAIMER);
 
 	context = getNewContext();
 
 	/* Handle arguments passed to the program. */
 	if (argc == 1) {
+		if (!haveDisplay) {
+			printf("Cannot open display.\n");
+			exit(-1);
+		}
 		config = getNewConfiguration();
 		if (config != NULL) {
 			setContextConfig(context, config);
@@ -950,12 +1224,25 @@ int main(int argc, char **argv) {
 			exit(-1);
 		}
 		setContextConfig(context, config);
-		StartEverything(context);
+		if (config->batch) {
+			if (!runBatch(context))
+				exit(-1);
+			exit(0);
+		}
+		if (!haveDisplay) {
+			printf("Cannot open display, use the batch option to dump images "
+					"without one.\n");
+			exit(-1);
+		}
+		if (!StartEverything(context))
+			exit(-1);
 	}
 
 	/* Start gtk. */
 
 	gtk_main();
 
+	finishEncoders();
+
 	exit(0);
 }
@@ -82,6 +82,49 @@
 
 #define NUMFRAMES 8
 
+/* Define the maximum number of worker threads used for parallel stages */
+
+#define MAXWORKERS 64
+
+/* Minimum number of atoms for the rotation to be split over the workers */
+
+#define PARALLELATOMS 50000
+
+/* Maximum number of views of the frames shown side by side */
+
+#define MAXVIEWS 4
+
+/* Maximum number of periodic images drawn with the pbc option */
+
+#define MAXIMAGES 125
+
+/* Maximum number of bond options for pairs of atom types */
+
+#define MAXBONDRULES 32
+
+/* Maximum number of keyframes of a camera path */
+
+#define MAXCAMERAKEYS 256
+
+/* Define the maximum number of dumped images waiting to be encoded */
+
+#define ENCODEQUEUE 16
+#define VIDEOFPS 25
+
+/* Number of rows of a tiled dump rendered at a time */
+
+#define EXPORTROWS 256
+
+/* How much the farthest atoms are faded into the background by depthcue */
+
+#define DEPTHCUE 0.7
+
+/* Number of steps the radius of atoms varying in size and the fading of
+ depth cueing are looked up in */
+
+#define RADIUSSTEPS 256
+#define CUESTEPS 64
+
 /* Define debug constant, if set to TRUE additional debugging info will be printed 
  out during the running of the program. */
 
@@ -105,6 +148,23 @@
 #define DEFAULT_DUMPNUM FALSE
 #define DEFAULT_INTERVAL 0
 #define DEFAULT_DUMPNAME '\0'
+#define DEFAULT_VIDEODUMP 0
+#define DEFAULT_LOD 0
+#define DEFAULT_PBC 1
+#define DEFAULT_BONDCUTOFF 0.0
+#define DEFAULT_PERSPFOV 45.0
+#define DEFAULT_PERSPDIST 0.0
+#define DEFAULT_DEPTHCUE FALSE
+#define DEFAULT_TRAIL 1.0
+#define DEFAULT_VIEWS 1
+#define DEFAULT_INTERPOLATE 0
+#define DEFAULT_HERMITE FALSE
+#define DEFAULT_PRECISION 64
+#define DEFAULT_VALIDATE FALSE
+#define DEFAULT_SLAB FALSE
+#define DEFAULT_ZBUFFER FALSE
+#define DEFAULT_DENSITY 0
+#define DEFAULT_CULL FALSE
 
 #define X_VECTOR { 1.0, 0.0, 0.0 }
 #define Y_VECTOR { 0.0, 1.0, 0.0 }
@@ -116,11 +176,43 @@ struct Atom {
 	double xcoord; /* X-coordinate */
 	double ycoord; /* Y-coordinate */
 	double zcoord; /* Z-coordinate */
-	double tcoord; /* t-coordinate */
+	double tcoord; /* t-coordinate, depth of rotated atoms */
 	gint atype; /* atom type */
 	gint index; /* index */
 };
 
+/* Declaration of structures holding the coordinates of an atom in less
+ precision for the transform, the coordinates are origin + scale * x
+ with the origin and scale of their frame. They are a cache kept next to
+ the doubles, which the rest of the program still reads. */
+
+struct FloatAtom {
+	float x, y, z;
+	gint atype;
+};
+
+struct ShortAtom {
+	guint16 x, y, z;
+	guint8 atype; /* Types are below MAXTYPES */
+};
+
+/* Declaration of structure which gives the bond cutoff of a pair of atom
+ types. */
+
+struct BondRule {
+	gchar type1[5]; /* Names of the atom types */
+	gchar type2[5];
+	double cutoff; /* Atoms closer than this are bonded */
+};
+
+/* Declaration of structure which gives the orientation of the camera at
+ a keyframe of a camera path. */
+
+struct CameraKey {
+	gint frame; /* Number of the frame */
+	double q[4]; /* Orientation as a unit quaternion w, x, y, z */
+};
+
  struct Frame {
  	double xmin; 				/* Minimum x coordinate of frame */
  	double xmax; 				/* Maximum x coordinate of frame */
@@ -133,8 +225,21 @@ struct Atom {
  	GMutex *framedrawn; 		/* Control variables for 'Is the frame currently being drawn?' */
  	gint numAtoms; 				/* Number of atoms in frame */
  	struct Atom *atomdata;		/* Data of frame */
+ 	double centroidx, centroidy, centroidz; /* Mean position of the atoms */
+ 	double radius;				/* Distance of the farthest atom from the centroid */
+ 	gint numBonded;				/* Number of atoms bonds were searched for */
+ 	gint *bondStart;			/* Bonds of atom i are bondPartner[bondStart[i]..bondStart[i+1]-1] */
+ 	gint *bondPartner;			/* Indices of the bonded atoms */
+ 	gint bondStartAlloc, bondPartnerAlloc; /* Allocated sizes, reused by later frames */
+ 	gint packing;				/* Bits of the packed coordinates, 32 or 16, 0 if none */
+ 	gpointer packed;			/* Cache of FloatAtoms or ShortAtoms the transform reads, NULL if none */
+ 	gsize packedAlloc;			/* Allocated size in bytes, reused by later frames */
+ 	double packOrigin[3], packScale; /* Packed coordinates are origin + scale * packed */
+ 	gchar types[MAXTYPES][5];	/* Names of the atom types of xyz files */
+ 	gint numTypes;				/* Number of named types */
  	double atime; 				/* Timestamp of frame */
 	gint numframe; 				/* Number of the frame */
+ 	guint generation;			/* Counts every frame read, never the same for two frames */
  	gboolean lastFrame;
  };
 
@@ -156,6 +261,7 @@ struct Configuration {
 	gint scol; /* Something */
 	gint interval; /* Interval in milliseconds between frames */
 	gint numtypes; /* Number of atomtypes */
+	gint density; /* Draw a density map instead of atoms, 0 = off */
 	double xcolorset[17][3];
 	double initIangle; /* Initial angle of view around x */
 	double initJangle; /* Initial angle of view around y */
@@ -166,9 +272,6 @@ struct Configuration {
 	double ymax; /* Maximum y coordinate */
 	double zmin; /* Minumum z coordinate */
 	double zmax; /* Maximum z coordinate */
-	double xc; /* Angular correction, x-wise */
-	double yc; /* Angular correction, y-wise */
-	double zc; /* Angular correction, z-wise */
 	gboolean waitForNextFramePress; /* Do we want to wait after every frame for a middle button press ? */
 	gboolean backgroundWhite; /* Do we want a white background ? */
 	gboolean erasePreviousFrame; /* Do we want to erase the old frame before drawing a new one ? */
@@ -177,12 +280,159 @@ struct Configuration {
 	gboolean tifjpg; /* Do we want tifs or jpgs to be dumped ? */
 	gboolean useTypesForColoring; /* Will the be coloring according to atomtypes ? */
 	gboolean oneLoop; /* Loop through animation once, then quit automatically */
+	gboolean zbuffer; /* Do we want to use a depth buffer instead of sorting the atoms ? */
+	gboolean cull; /* Do we want to skip atoms hidden behind nearer atoms ? */
+	gboolean batch; /* Dump all frames without opening any windows */
+	double bondCutoff; /* Atoms closer than this are bonded, 0 = no bonds */
+	gint numBondRules; /* Number of cutoffs for pairs of atom types */
+	struct BondRule bondRules[MAXBONDRULES];
+	gint numCameraKeys; /* Number of keyframes of the camera path, 0 = no path */
+	struct CameraKey cameraKeys[MAXCAMERAKEYS];
+	double perspFov; /* Field of view of the perspective camera in degrees */
+	double perspDist; /* Distance of the camera from the center, 0 = no perspective */
+	gboolean depthcue; /* Do we want far atoms faded into the background ? */
+	double trail; /* How much of the trail is kept each frame without erase, 1 = all */
+	gboolean slab; /* Are only the atoms inside a slab drawn ? */
+	double slabNormal[3]; /* Unit normal of the slab */
+	double slabMin, slabMax; /* Distances along the normal the slab is between */
+	gint pbc[3]; /* Number of periodic images along x, y and z */
+	gint lod; /* Time in ms a preview drawn while rotating may take, 0 = no previews */
+	gint numViews; /* Number of views of the frames side by side */
+	gint interpolate; /* Number of frames drawn between two frames read, 0 = none */
+	gboolean hermite; /* Are the frames in between on a cubic curve instead of a line ? */
+	gint precision; /* Bits of the coordinates the atoms are rotated with, 64, 32 or 16 */
+	gboolean validate; /* Are atoms rotated with less precision compared to doubles ? */
+	gint videodump; /* Write a video, 0 = no, 1 = y4m file, 2 = pipe to command */
 	gchar fstring[30]; /* String to check for in inputlines */
 	gchar file[256]; /* Name of input file */
 	gchar dumpname[50]; /* Names of dumped images */
+	gchar videoname[256]; /* Video file or command the video is piped to */
+	gchar exportname[50]; /* Names of tiled dumps */
+	gint exportWidth, exportHeight; /* Size of tiled dumps in pixels */
+	gint tileTop; /* First row of the image drawn, set for tiled dumps */
+	gint tileRows; /* Number of rows drawn, 0 = the whole image */
 	gchar timedelim[20]; /* Delimiter for time readings in xyz-format */
 };
 
+/* Declaration of structure holding the volume drawn of the rotated atoms
+ of a frame, it depends on the orientation and is found for every view
+ each time the atoms are rotated. */
+struct Extent {
+	double xmin, xmax; /* Rotated x drawn */
+	double ymin, ymax; /* Rotated y drawn */
+	double zmin, zmax; /* z drawn, as read */
+	double depthmin, depthmax; /* Rotated z of the atoms drawn */
+	double zcenter; /* Rotated z of the center, 0 if not in perspective */
+};
+
+/* Declaration of structure mapping the pixels of the drawn frame to the
+ atoms drawn topmost on them, it is filled while the frame is drawn. */
+struct PickGrid {
+	gint width, height; /* Size in pixels */
+	gint *atoms; /* Index of the topmost atom on each pixel, -1 if none */
+	gint alloc; /* Allocated size of atoms */
+	struct Frame *frame; /* Frame the atoms are from */
+	guint generation; /* Generation of that frame */
+	gint step; /* Step between frames drawn */
+	struct Extent extent; /* Volume of the rotated atoms drawn */
+};
+
+/* Declaration of structure holding the factors that project atoms of a
+ frame onto the pixmap, they are computed once for every frame. */
+struct Projection {
+	double xmin, xscale; /* Pixmap x is (xcoord - xmin) * xscale */
+	double ymin, yscale; /* Pixmap y is (ycoord - ymin) * yscale */
+	double zmin, zmax; /* Drawn volume in z */
+	double ctype, cz; /* Color index from atom type and z - zmin */
+	double rstep; /* Step of the radius is (z - zmin) * rstep */
+	double distance, toward, zshift; /* Radius is scaled by distance / (distance - toward * depth + zshift) */
+	double cuenear, cuestep; /* Step of the fading is (cuenear - depth) * cuestep */
+	gint xlimit, ylimit; /* Atoms must be inside 0 < x < xlimit etc. */
+	gint absysize;
+	gint tiletop; /* Pixmap row drawn at the top of the surface */
+	struct PickGrid *pick; /* Filled with the drawn atoms if not NULL */
+	gint radius[RADIUSSTEPS]; /* Radius of the atoms by their step of z */
+	double shade[NUMCOLORS + 1][CUESTEPS][3]; /* Colorset faded by the steps of depth cueing */
+	guint32 pixels[NUMCOLORS + 1][CUESTEPS]; /* Likewise as packed pixels, set for zbuffer and density */
+};
+
+/* Declaration of structure describing the periodic images of the rotated
+ frame, the first image is the frame itself. */
+struct Images {
+	gint num; /* Number of images */
+	double offset[MAXIMAGES][4]; /* Rotated x, y and depth, and unrotated z */
+	double distance, zcenter; /* Perspective camera, distance 0 if none */
+};
+
+/* Declaration of structure holding a buffer that is reused from one draw
+ to the next, it only grows and is kept for the life of the context. */
+struct Scratch {
+	gpointer data;
+	gsize alloc; /* Allocated size in bytes */
+};
+
+/* Declaration of structure holding the buffers used while a frame is
+ drawn, so that drawing allocates nothing once they have grown to the
+ size of the frames. */
+struct DrawBuffers {
+	struct Scratch images; /* Periodic images or culled copy of the rotated atoms */
+	struct Scratch bonded; /* Rotated atoms placed by their index */
+	struct Scratch depth; /* Depth of each pixel with the zbuffer option */
+	struct Scratch coverage; /* Covered pixels with the cull option */
+	struct Scratch histogram; /* Histogram of the density map */
+	struct Scratch binned; /* Pixel and order of the atoms in the density map */
+	cairo_surface_t *pixels; /* Image of the zbuffer and density drawing */
+	cairo_surface_t *window; /* Surface the window is drawn on */
+	gint windowWidth, windowHeight; /* Size of that surface */
+};
+
+/* Declaration of structure describing an atom by its distance along the
+ slab normal */
+struct SlabAtom {
+	double key;
+	gint index;
+};
+
+/* Declaration of structure holding the atoms of a frame sorted along the
+ slab normal, kept for as long as the same frame is drawn. */
+struct SlabIndex {
+	struct Frame *frame; /* Frame the atoms are from */
+	guint generation; /* Generation of that frame */
+	gint numatoms;
+	double normal[3];
+	gboolean sorted; /* Has the frame been drawn before, so it was sorted ? */
+	struct Scratch atoms; /* Atoms sorted by their distance along the normal */
+};
+
+/* Declaration of structure holding the rotated atoms of the frame drawn
+ last in drawing order, they are reused while the same frame is drawn in
+ the same orientation, as when the window is resized or recolored. */
+struct TransformCache {
+	struct Frame *frame; /* Frame the atoms are from, NULL if none */
+	guint generation; /* Generation of that frame */
+	gint numatoms;
+	double m[3][3]; /* Rotation */
+	gboolean slab;
+	double slabNormal[3], slabMin, slabMax;
+	double perspDist;
+	gint order; /* 0 unsorted, 1 and 2 sorted like config->sort */
+	struct Scratch atoms; /* Rotated atoms */
+	struct Scratch check; /* Atoms rotated as doubles when validating */
+	gint num; /* Number of rotated atoms */
+	struct Extent extent; /* Volume the rotated atoms are drawn in */
+	gboolean hit; /* Were the atoms reused by the last rotation ? */
+};
+
+/* Declaration of structure holding the faded earlier frames drawn on one
+ target when they aren't erased. */
+struct Trail {
+	cairo_surface_t *surface; /* Faded earlier frames */
+	cairo_surface_t *layer; /* Atoms of the frame drawn last */
+	struct Frame *frame; /* Frame held in the layer, NULL if none */
+	guint generation; /* Generation of that frame */
+	gint step; /* Step between frames of that frame */
+};
+
 /* Declaration of structure used for passing information to drawing functions */
 struct Context {
 	gint crXSize, crYSize;
@@ -192,6 +442,26 @@ struct Context {
 	gboolean pausecheck; /* Is animation on pause ? */
 	gboolean setupstop; /* Is the animation being configured ? */
 	gboolean pressed; /* Is mousebutton pressed down on pixmap ? */
+	gboolean preview; /* Is only a part of the atoms drawn while rotating ? */
+	double atomDrawTime; /* Time in ms it took to draw one atom in the last frame */
+	gboolean picking; /* Is the picking grid filled while drawing ? */
+	struct PickGrid pick; /* Atoms under the pixels of the window */
+	struct Images images; /* Periodic images of the frame being drawn */
+	double rotation[3][3]; /* Orientation of the view */
+	struct SlabIndex slab; /* Atoms of the frame drawn sorted along the slab normal */
+	struct TransformCache transform; /* Rotated atoms of the frame drawn last */
+	struct DrawBuffers buffers; /* Buffers reused by every draw */
+	struct Context *owner; /* Context reading the frames, itself for the first view */
+	struct Context *views[MAXVIEWS]; /* Views of the frames, set in the owner */
+	gint numViews;
+	struct Context *activeView; /* View the buttons and setup change, set in the owner */
+	struct Frame *drawnFrame; /* Frame this view has drawn last */
+	gboolean dumpPending; /* Is the frame dumped once the window has drawn it ? */
+	struct Trail trail; /* Earlier frames drawn in the window */
+	struct Trail dumpTrail; /* Earlier frames drawn in the dumped images */
+	struct Frame *interpFrom; /* Frame read before the current one, kept while steps are drawn, set in the owner */
+	struct Frame *interpBefore; /* Frame read before interpFrom, kept for cubic steps, set in the owner */
+	gint interpStep; /* Step drawn after interpFrom, interpolate + 1 at the current frame */
 	double iangle; /* Angle of view around x */
 	double jangle; /* Angle of view around y */
 	double kangle; /* Angle of view around z */
@@ -215,20 +485,67 @@ struct AngleAdjustment {
 
 /* Declaration of extern functions used throughout the program */
 
-void StartEverything(struct Context *context);
+gboolean StartEverything(struct Context *context);
+gboolean startReading(struct Context *context);
+gboolean runBatch(struct Context *context);
 
 void showSetupWindow(struct Context *context);
 void setupStartOk(struct Context *context, struct Configuration *newconfig);
 void setupStartCancel(struct Context *context);
 void setupApplyNewConfig(struct Context *context, struct Configuration *newconfig);
 
-void drawFrame(struct Context *context, cairo_t *cr);
-void clearFrame(struct Context *context, cairo_t *cr);
+void drawFrame(struct Context *context, cairo_t *cr, struct Trail *trail);
+gpointer growScratch(struct Scratch *scratch, gsize size);
+cairo_surface_t * getPixelSurface(cairo_surface_t **surface, gint width,
+		gint height);
+void setupProjection(struct Extent *extent, struct Configuration *config,
+		struct PickGrid *pick, struct Projection *proj);
+gboolean projectAtom(struct Projection *proj, struct Atom *atom, gint *x,
+		gint *y, gint *c, gint *r);
+gint getCueStep(struct Projection *proj, double depth);
+gint transformAbsoluteToRelative(double x, double xmin, double xmax, gint absxsize);
+void startPicking(struct PickGrid *pick, struct Frame *frame, gint step,
+		gint width, gint height);
+void markPicked(struct PickGrid *pick, gint x, gint y, gint r,
+		gboolean square, gint index);
+struct Atom * findPickedAtom(struct Context *context, gint x, gint y);
+void drawAtomsZBuffer(cairo_t *cr, struct Extent *extent, struct Atom *coords,
+		gint numatoms, struct Configuration *config,
+		struct DrawBuffers *buffers, struct PickGrid *pick);
+guint32 packColor(double r, double g, double b);
+void drawAtomsDensity(cairo_t *cr, struct Extent *extent, struct Atom *coords,
+		gint numatoms, struct Configuration *config,
+		struct DrawBuffers *buffers);
+void drawAtomsImages(cairo_t *cr, struct Frame *frame, struct Extent *extent,
+		struct Atom *coords, gint numatoms, struct Configuration *config, struct Images *images,
+		struct Atom *byindex, struct PickGrid *pick);
+struct Atom * replicateImages(struct Atom *coords, gint numatoms,
+		struct Images *images, gboolean reverse, gint *numimaged,
+		struct Scratch *scratch);
+void findBonds(struct Frame *frame, gint numatoms,
+		struct Configuration *config, gchar types[][5], gint numtypes);
+struct Atom * getBondedAtoms(struct Frame *frame, struct Atom *coords,
+		gint numatoms, struct Configuration *config, struct Scratch *scratch);
+gint cullHiddenAtoms(struct Extent *extent, struct Atom *coords, gint numatoms,
+		struct Configuration *config, struct DrawBuffers *buffers);
+
+void initWorkers();
+gint getNumWorkers();
+void runParallel(void (*func)(gint part, gint numparts, gpointer data),
+		gpointer data);
+void clearFrame(cairo_t *cr, struct Configuration *config, gint width,
+		gint height);
+void drawAtoms(cairo_t *cr, struct Frame *frame, struct Extent *extent,
+		struct Atom *coords, gint numatoms, struct Configuration *config,
+		struct Atom *byindex, struct PickGrid *pick);
 
 void mouseRotate(GtkWidget *widget, gint xdelta, gint ydelta,
 		struct Context *context);
-struct Atom * rotateAtoms(struct Context *context);
-void resetOrientation();
+struct Atom * rotateAtoms(struct Context *context,
+		struct Configuration *config, struct Extent *extent, gint *numrotated);
+void resetOrientation(struct Context *context);
+void getViewAngles(struct Context *context, double *xc, double *yc,
+		double *zc);
 void angleAdjustmentButtonPressed(GtkWidget *widget, struct AngleAdjustment *angleAdjustment);
 void resetOrientationButtonPressed(GtkWidget *widget, struct Context *context);
 
@@ -236,10 +553,32 @@ void sortatoms(struct Atom *coords, gint left, gint right, gboolean sort);
 
 void triggerImageRedraw(GtkWidget *widget, struct Context *context);
 
+void getDumpName(struct Context *context, gchar *picname);
+cairo_surface_t * renderFrameImage(struct Context *context);
+gboolean writeFrameImage(cairo_surface_t *image, const gchar *picname,
+		gboolean png);
+void dumpFrame(struct Context *context, cairo_surface_t *drawn);
+void finishEncoders();
+gboolean writeVideoFrame(gint videodump, const gchar *videoname,
+		cairo_surface_t *image);
+void closeVideo();
+void exportFrame(struct Context *context);
+
 void setColorset(struct Configuration *config);
 
+gboolean readCameraPath(struct Configuration *config, const gchar *file);
+void getCameraRotation(struct Configuration *config, double numframe,
+		double m[3][3]);
+void passFrame(struct Context *context, struct Frame *previousFrame);
+gboolean betweenFrames(struct Context *context);
+struct Frame * getInterpolation(struct Context *context, struct Frame **before,
+		double *w);
+gint getShownFrameNumber(struct Context *context);
+double getShownFrameTime(struct Context *context);
+
 void * readInput(struct Context *context);
 
 struct Configuration * getNewConfiguration();
+struct Context * getNewContext();
 struct Configuration * copyConfiguration(struct Configuration *oldconfig);
 struct Configuration * handleArgs(int args, char **argv);
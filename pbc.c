@@ -0,0 +1,168 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include "parameters.h"
+
+/* Number of atoms merged from the images before they are drawn */
+#define MERGEBATCH 1024
+
+/* Structure describing the merging of the sorted images of a frame */
+struct ImageMerge {
+	struct Atom *coords;
+	gint numatoms;
+	struct Images *images;
+	gboolean reverse; /* Are the atoms sorted in reverse order ? */
+	gint heap[MAXIMAGES]; /* Images ordered by the depth of their next atom */
+	gint next[MAXIMAGES]; /* Next atom of each image */
+	gint heapsize;
+};
+
+/************************************************************************/
+/* Returns the depth of the next atom of an image, negated if the atoms	*/
+/* are sorted in reverse so that the smallest key is always drawn next.	*/
+/************************************************************************/
+static double imageKey(struct ImageMerge *merge, gint k) {
+	double key;
+
+	key = merge->coords[merge->next[k]].tcoord + merge->images->offset[k][2];
+	return merge->reverse ? -key : key;
+}
+
+/************************************************************************/
+/* Moves the image at position i of the heap down to its place.		*/
+/************************************************************************/
+static void siftDown(struct ImageMerge *merge, gint i) {
+	gint child, k;
+
+	k = merge->heap[i];
+	while ((child = 2 * i + 1) < merge->heapsize) {
+		if (child + 1 < merge->heapsize
+				&& imageKey(merge, merge->heap[child + 1])
+						< imageKey(merge, merge->heap[child]))
+			child++;
+		if (imageKey(merge, k) <= imageKey(merge, merge->heap[child]))
+			break;
+		merge->heap[i] = merge->heap[child];
+		i = child;
+	}
+	merge->heap[i] = k;
+}
+
+/************************************************************************/
+/* Prepares the merging of the images of the sorted atoms.		*/
+/************************************************************************/
+static void startMerge(struct ImageMerge *merge, struct Atom *coords,
+		gint numatoms, struct Images *images, gboolean reverse) {
+	gint k;
+
+	merge->coords = coords;
+	merge->numatoms = numatoms;
+	merge->images = images;
+	merge->reverse = reverse;
+	merge->heapsize = (numatoms > 0) ? images->num : 0;
+	for (k = 0; k < merge->heapsize; k++) {
+		merge->heap[k] = k;
+		merge->next[k] = 0;
+	}
+	for (k = merge->heapsize / 2 - 1; k >= 0; k--)
+		siftDown(merge, k);
+}
+
+/************************************************************************/
+/* Writes up to max of the next atoms of all images in depth order to	*/
+/* out, moved to the place of their image. Returns the number written.	*/
+/************************************************************************/
+static gint mergeAtoms(struct ImageMerge *merge, struct Atom *out, gint max) {
+	gint n, k;
+	double *offset, d, depth, scale;
+
+	d = merge->images->distance;
+	n = 0;
+	while (n < max && merge->heapsize > 0) {
+		k = merge->heap[0];
+		offset = merge->images->offset[k];
+
+		out[n] = merge->coords[merge->next[k]];
+		merge->next[k]++;
+		if (merge->next[k] == merge->numatoms)
+			merge->heap[0] = merge->heap[--merge->heapsize];
+		siftDown(merge, 0);
+
+		/* In perspective the atom is moved before it is projected again,
+		 images behind the camera are left out. */
+		if (d > 0.0) {
+			depth = d - (out[n].tcoord + offset[2] - merge->images->zcenter);
+			if (depth < 0.01 * d)
+				continue;
+			scale = (d - (out[n].tcoord - merge->images->zcenter)) / d;
+			out[n].xcoord = (out[n].xcoord * scale + offset[0]) * (d / depth);
+			out[n].ycoord = (out[n].ycoord * scale + offset[1]) * (d / depth);
+		} else {
+			out[n].xcoord += offset[0];
+			out[n].ycoord += offset[1];
+		}
+		out[n].tcoord += offset[2];
+		out[n].zcoord += offset[3];
+		n++;
+	}
+	return n;
+}
+
+/************************************************************************/
+/* Draws the sorted atoms and all their periodic images. The images are	*/
+/* merged by depth a batch at a time, so the replicated atoms are never	*/
+/* all in memory. The atoms are marked in pick if it isn't NULL.	*/
+/************************************************************************/
+void drawAtomsImages(cairo_t *cr, struct Frame *frame, struct Extent *extent,
+		struct Atom *coords, gint numatoms, struct Configuration *config, struct Images *images,
+		struct Atom *byindex, struct PickGrid *pick) {
+	struct ImageMerge merge;
+	struct Atom batch[MERGEBATCH];
+	gint n;
+
+	startMerge(&merge, coords, numatoms, images, config->sort == 2);
+	while ((n = mergeAtoms(&merge, batch, MERGEBATCH)) > 0)
+		drawAtoms(cr, frame, extent, batch, n, config, byindex, pick);
+}
+
+/************************************************************************/
+/* Returns a new array with the atoms of all periodic images in depth	*/
+/* order, for the drawing modes that need all atoms at once. Their	*/
+/* number is returned in numimaged. The atoms are held in scratch.	*/
+/************************************************************************/
+struct Atom * replicateImages(struct Atom *coords, gint numatoms,
+		struct Images *images, gboolean reverse, gint *numimaged,
+		struct Scratch *scratch) {
+	struct ImageMerge merge;
+	struct Atom *imagecoords;
+
+	imagecoords = (struct Atom *) growScratch(scratch,
+			numatoms * images->num * sizeof(struct Atom));
+	startMerge(&merge, coords, numatoms, images, reverse);
+	*numimaged = mergeAtoms(&merge, imagecoords, numatoms * images->num);
+	return imagecoords;
+}
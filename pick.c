@@ -0,0 +1,114 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <string.h>
+#include "parameters.h"
+
+/************************************************************************/
+/* Makes the picking grid the size of the drawn area and empties it,	*/
+/* before the atoms of a frame are drawn at the step between frames.	*/
+/************************************************************************/
+void startPicking(struct PickGrid *pick, struct Frame *frame, gint step,
+		gint width, gint height) {
+	if (width * height > pick->alloc) {
+		g_free(pick->atoms);
+		pick->alloc = width * height;
+		pick->atoms = g_malloc(pick->alloc * sizeof(gint));
+	}
+	pick->width = width;
+	pick->height = height;
+	pick->frame = frame;
+	pick->generation = frame->generation;
+	pick->step = step;
+
+	/* All bytes set gives -1 in every element. */
+	memset(pick->atoms, 0xff, width * height * sizeof(gint));
+}
+
+/************************************************************************/
+/* Marks the pixels an atom was drawn on, with the same footprint as	*/
+/* the drawing modes. The atoms are drawn back to front, so the last	*/
+/* atom marked on a pixel is the one seen.				*/
+/************************************************************************/
+void markPicked(struct PickGrid *pick, gint x, gint y, gint r,
+		gboolean square, gint index) {
+	gint x0, y0, x1, y1, px, py;
+	gint *row;
+
+	if (square) {
+		x0 = x - r / 2;
+		y0 = y - r / 2;
+		x1 = x0 + r - 1;
+		y1 = y0 + r - 1;
+	} else {
+		x0 = x - r;
+		y0 = y - r;
+		x1 = x + r;
+		y1 = y + r;
+	}
+	x0 = MAX(x0, 0);
+	y0 = MAX(y0, 0);
+	x1 = MIN(x1, pick->width - 1);
+	y1 = MIN(y1, pick->height - 1);
+
+	for (py = y0; py <= y1; py++) {
+		row = pick->atoms + py * pick->width;
+		for (px = x0; px <= x1; px++) {
+			if (!square
+					&& (px + 0.5 - x) * (px + 0.5 - x)
+							+ (py + 0.5 - y) * (py + 0.5 - y) > r * r)
+				continue;
+			row[px] = index;
+		}
+	}
+}
+
+/************************************************************************/
+/* Returns the atom seen at a pixel of the window, as it was read from	*/
+/* the file, or NULL if there is none. Only the frame on the screen is	*/
+/* looked at, the grid is left as it is until it is drawn again.	*/
+/************************************************************************/
+struct Atom * findPickedAtom(struct Context *context, gint x, gint y) {
+	struct PickGrid *pick;
+	struct Frame *frame;
+	gint index;
+
+	pick = &(context->pick);
+	frame = context->currentFrame;
+
+	if (frame == NULL || pick->frame != frame
+			|| pick->generation != frame->generation
+			|| pick->step != context->owner->interpStep)
+		return NULL;
+	if (x < 0 || y < 0 || x >= pick->width || y >= pick->height)
+		return NULL;
+
+	index = pick->atoms[y * pick->width + x];
+	if (index < 0 || index >= frame->numAtoms)
+		return NULL;
+	return &(frame->atomdata[index]);
+}
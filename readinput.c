@@ -24,6 +24,7 @@
  */
 
 #include <gtk/gtk.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include "parameters.h"
@@ -38,6 +39,116 @@ void initFrame(struct Frame *frame) {
 	frame->atomdata = NULL;
 }
 
+/************************************************************************/
+/* Finds the sphere around the atoms of a frame, centered on their	*/
+/* mean position, which gives their bounds in every orientation.	*/
+/************************************************************************/
+static void findBoundingSphere(struct Frame *frame, gint numatoms) {
+	gint i;
+	double cx, cy, cz, dx, dy, dz, r2, max2;
+	struct Atom *coords;
+
+	coords = frame->atomdata;
+	cx = cy = cz = 0.0;
+	for (i = 0; i < numatoms; i++) {
+		cx += coords[i].xcoord;
+		cy += coords[i].ycoord;
+		cz += coords[i].zcoord;
+	}
+	if (numatoms > 0) {
+		cx /= numatoms;
+		cy /= numatoms;
+		cz /= numatoms;
+	}
+
+	max2 = 0.0;
+	for (i = 0; i < numatoms; i++) {
+		dx = coords[i].xcoord - cx;
+		dy = coords[i].ycoord - cy;
+		dz = coords[i].zcoord - cz;
+		r2 = dx * dx + dy * dy + dz * dz;
+		if (r2 > max2)
+			max2 = r2;
+	}
+
+	frame->centroidx = cx;
+	frame->centroidy = cy;
+	frame->centroidz = cz;
+	frame->radius = sqrt(max2);
+}
+
+/************************************************************************/
+/* Returns the nearest 16 bit step of x from origin.			*/
+/************************************************************************/
+static guint16 quantize(double x, double origin, double scale) {
+	double q;
+
+	q = (x - origin) / scale + 0.5;
+	return (guint16) CLAMP(q, 0.0, G_MAXUINT16);
+}
+
+/************************************************************************/
+/* Packs the coordinates of the atoms of a frame into floats relative	*/
+/* to their centroid, or into 16 bit steps across their bounding	*/
+/* sphere, for the transform to read instead of the doubles. The packed	*/
+/* atoms are a cache next to the doubles, so they cost memory and are	*/
+/* freed as soon as the full precision is used again.			*/
+/************************************************************************/
+static void packFrame(struct Frame *frame, gint numatoms, gint precision) {
+	gint i;
+	gsize size;
+	double scale, *origin;
+	struct Atom *coords;
+	struct FloatAtom *floats;
+	struct ShortAtom *shorts;
+
+	frame->packing = 0;
+	if (precision != 32 && precision != 16) {
+		g_free(frame->packed);
+		frame->packed = NULL;
+		frame->packedAlloc = 0;
+		return;
+	}
+
+	size = numatoms * ((precision == 32) ?
+			sizeof(struct FloatAtom) : sizeof(struct ShortAtom));
+	if (size > frame->packedAlloc) {
+		g_free(frame->packed);
+		frame->packed = g_malloc(size);
+		frame->packedAlloc = size;
+	}
+	coords = frame->atomdata;
+	origin = frame->packOrigin;
+
+	if (precision == 32) {
+		origin[0] = frame->centroidx;
+		origin[1] = frame->centroidy;
+		origin[2] = frame->centroidz;
+		frame->packScale = 1.0;
+		floats = (struct FloatAtom *) frame->packed;
+		for (i = 0; i < numatoms; i++) {
+			floats[i].x = (float) (coords[i].xcoord - origin[0]);
+			floats[i].y = (float) (coords[i].ycoord - origin[1]);
+			floats[i].z = (float) (coords[i].zcoord - origin[2]);
+			floats[i].atype = coords[i].atype;
+		}
+	} else {
+		origin[0] = frame->centroidx - frame->radius;
+		origin[1] = frame->centroidy - frame->radius;
+		origin[2] = frame->centroidz - frame->radius;
+		scale = (frame->radius > 0.0) ? 2.0 * frame->radius / G_MAXUINT16 : 1.0;
+		frame->packScale = scale;
+		shorts = (struct ShortAtom *) frame->packed;
+		for (i = 0; i < numatoms; i++) {
+			shorts[i].x = quantize(coords[i].xcoord, origin[0], scale);
+			shorts[i].y = quantize(coords[i].ycoord, origin[1], scale);
+			shorts[i].z = quantize(coords[i].zcoord, origin[2], scale);
+			shorts[i].atype = (guint8) coords[i].atype;
+		}
+	}
+	frame->packing = precision;
+}
+
 
 /************************************************************************/
 /* Reads the input file and processes it, then it calls rotateatoms to	*/
@@ -50,6 +161,8 @@ void * readInput(struct Context *context) {
 	gchar AType[MAXTYPES][5];
 
 	gint n, i, j, numtypes, nreadxyz, numalloc, numatoms, previousFrameNum;
+	gint frameCount;
+	guint generation;
 
 	double maxx, maxy, maxz, minx, miny, minz;
 
@@ -65,6 +178,8 @@ void * readInput(struct Context *context) {
 #endif
 
 	framecheck = FALSE;
+	frameCount = 0;
+	generation = 0;
 
 	while (1) {
 		g_mutex_lock(context->atEnd);
@@ -87,10 +202,15 @@ void * readInput(struct Context *context) {
 			context->fp = NewFP;
 			NewFP = NULL;
 			fclose(fpRI);
+			frameCount = 0;
 		}
 		fpRI = context->fp;
 
 		initFrame(&(context->framedata[NumFrameRI]));
+		context->framedata[NumFrameRI].numframe = frameCount;
+		/* The number of the frame starts again with a new file, the
+		 generation tells the frames apart for the caches of the views. */
+		context->framedata[NumFrameRI].generation = ++generation;
 
 		/* If file is in xyz format start reading here ! */
 		if (context->config->inputFormatXYZ) {
@@ -225,6 +345,8 @@ void * readInput(struct Context *context) {
 					break;
 				}
 			}
+			/* Lines dropped by scol or the end of the file are not atoms. */
+			context->framedata[NumFrameRI].numAtoms = numatoms;
 			if (context->config->xmin == 65535.0) {
 				context->framedata[NumFrameRI].xmax = maxx;
 				context->framedata[NumFrameRI].xmin = minx;
@@ -247,8 +369,22 @@ void * readInput(struct Context *context) {
 				context->framedata[NumFrameRI].zmin = context->config->zmin;
 			}
 
+			findBoundingSphere(&(context->framedata[NumFrameRI]), numatoms);
+			packFrame(&(context->framedata[NumFrameRI]), numatoms,
+					context->config->precision);
+
+			/* The bonds are found here so that it overlaps with drawing. */
+			findBonds(&(context->framedata[NumFrameRI]), numatoms,
+					context->config, AType, numtypes);
+
+			/* The names of the types are kept for showing picked atoms. */
+			memcpy(context->framedata[NumFrameRI].types, AType,
+					MIN(numtypes, MAXTYPES) * sizeof(AType[0]));
+			context->framedata[NumFrameRI].numTypes = MIN(numtypes, MAXTYPES);
+
 			context->config->numtypes = numtypes;
 			g_mutex_unlock(context->framedata[NumFrameRI].frameready);
+			frameCount++;
 
 			previousFrameNum = NumFrameRI;
 			NumFrameRI++;
@@ -375,7 +511,18 @@ void * readInput(struct Context *context) {
 			if (context->framedata[NumFrameRI].atomdata != NULL)
 				g_free(context->framedata[NumFrameRI].atomdata);
 			context->framedata[NumFrameRI].atomdata = coords;
+
+			findBoundingSphere(&(context->framedata[NumFrameRI]), i);
+			packFrame(&(context->framedata[NumFrameRI]), i,
+					context->config->precision);
+
+			/* There are no atom types in this format. */
+			findBonds(&(context->framedata[NumFrameRI]), i, context->config,
+					AType, 0);
+			context->framedata[NumFrameRI].numTypes = 0;
+
 			g_mutex_unlock(context->framedata[NumFrameRI].frameready);
+			frameCount++;
 
 			if (endframe) {
 				framecheck = FALSE;
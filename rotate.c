@@ -26,89 +26,615 @@
 #include <gtk/gtk.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "parameters.h"
 
-static double rotationVector[3][3] = { X_VECTOR, Y_VECTOR, Z_VECTOR };
+/* Structure holding all that the transform of the atoms needs, it is set
+ up once per frame so the loop over the atoms only reads it. */
+struct Transform {
+	struct Atom *coords; /* Atoms as read */
+	struct Atom *from; /* Atoms of the frame interpolated from, NULL if none */
+	struct Atom *before; /* Atoms of the frame read before from, NULL if not used */
+	double w[3]; /* Weights of before, from and coords when interpolating */
+	struct SlabAtom *slab; /* Atoms inside the slab, NULL if every atom is visited */
+	gboolean slabTest; /* Are the visited atoms tested against the slab ? */
+	double slabNormal[3], slabMin, slabMax;
+	guint32 keep; /* Atoms are kept in a preview if their hash is below this */
+	double m[3][3]; /* Rotation */
+	double xcenter, ycenter, zcenter; /* Rotated center of the frame */
+	double distance; /* Distance of a perspective camera, 0 if none */
+	struct FloatAtom *floats; /* Packed atoms read instead of coords, NULL if none */
+	struct ShortAtom *shorts; /* Likewise for 16 bit packed atoms */
+	float a[3][3], b[3]; /* Rotation of packed atoms with their scale and origin */
+	float zorigin, zscale; /* Unrotated z of packed atoms */
+	float slabKey[4]; /* Distance of packed atoms along the slab normal */
+};
+
+/* Structure describing one parallel transform, each worker transforms
+ a slice of the atoms into the same slice of out. */
+struct TransformJob {
+	const struct Transform *transform;
+	gint numatoms;
+	struct Atom *out;
+	gint counts[MAXWORKERS]; /* Number of atoms each worker kept */
+};
 
 /************************************************************************
  * The following procedure is the callback for angular change button
- * presses.
+ * presses. It rotates the view last clicked.
  ************************************************************************/
 void angleAdjustmentButtonPressed(GtkWidget *widget, struct AngleAdjustment *angleAdjustment) {
 	gint getval;
+	struct Context *context, *view;
 
-	if (g_mutex_trylock(angleAdjustment->context->atEnd) == TRUE) {
+	context = angleAdjustment->context;
+	view = context->activeView;
+
+	if (g_mutex_trylock(context->atEnd) == TRUE) {
 		getval = 1;
-		g_mutex_unlock(angleAdjustment->context->atEnd);
+		g_mutex_unlock(context->atEnd);
 	} else
 		getval = 0;
 
-	angleAdjustment->context->iangle = angleAdjustment->idelta;
-	angleAdjustment->context->jangle = angleAdjustment->jdelta;
-	angleAdjustment->context->kangle = angleAdjustment->kdelta;
-	if (angleAdjustment->context->pausecheck || getval == 0)
-		triggerImageRedraw(widget, angleAdjustment->context);
+	view->iangle = angleAdjustment->idelta;
+	view->jangle = angleAdjustment->jdelta;
+	view->kangle = angleAdjustment->kdelta;
+	if (context->pausecheck || getval == 0)
+		triggerImageRedraw(widget, view);
 }
 
 
 /************************************************************************
  * This procedure is called when the Reset orientation button is pressed.
- * It resets the angles and prints them in their entries.
+ * It resets the angles of the view last clicked and prints them in their
+ * entries.
  ************************************************************************/
 void resetOrientationButtonPressed(GtkWidget *widget, struct Context *context) {
-	resetOrientation();
-	triggerImageRedraw(widget, context);
+	resetOrientation(context->activeView);
+	triggerImageRedraw(widget, context->activeView);
 }
 
 /************************************************************************/
 /* This procedure is called after the mouse has been "dragged" on the	*/
-/* drawingboard. It calculates the rotational angles depending on the	*/
-/* dragged distance and direction and calls the rotating procedure.	*/
+/* drawingboard of a view. It calculates the rotational angles		*/
+/* depending on the dragged distance and direction and calls the	*/
+/* rotating procedure.							*/
 /************************************************************************/
 void mouseRotate(GtkWidget *widget, gint xdelta, gint ydelta,
 		struct Context *context) {
 	gint getval;
+	struct Context *owner;
 
-	if (g_mutex_trylock(context->atEnd) == TRUE) {
+	owner = context->owner;
+
+	if (g_mutex_trylock(owner->atEnd) == TRUE) {
 		getval = 1;
-		g_mutex_unlock(context->atEnd);
+		g_mutex_unlock(owner->atEnd);
 	} else
 		getval = 0;
 
 	context->imangle = (xdelta * 90.0) / (double) context->config->absxsize;
 	context->jmangle = (ydelta * 90.0) / (double) context->config->absysize;
-	if (context->pausecheck || context->config->waitForNextFramePress || getval == 0)
+	if (owner->pausecheck || context->config->waitForNextFramePress || getval == 0)
 		triggerImageRedraw(widget, context);
 }
 
+/************************************************************************/
+/* Computes the offsets of the periodic images of the frame after the	*/
+/* rotation m, and widens the bounds of the rotated atoms so that all	*/
+/* the images fit in the view.						*/
+/************************************************************************/
+static void setupImages(struct Context *context, struct Configuration *config,
+		double m[3][3], double zcenter, double *minx, double *maxx, double *miny,
+		double *maxy, double *minz, double *maxz, double *mindepth,
+		double *maxdepth) {
+	gint a, b, c, k;
+	double v[3], ominx, omaxx, ominy, omaxy, ominz, omaxz, omind, omaxd;
+	double *offset;
+	struct Frame *frame;
+
+	frame = context->currentFrame;
+
+	ominx = omaxx = ominy = omaxy = ominz = omaxz = omind = omaxd = 0.0;
+	k = 0;
+	for (a = 0; a < config->pbc[0]; a++) {
+		for (b = 0; b < config->pbc[1]; b++) {
+			for (c = 0; c < config->pbc[2]; c++) {
+				v[0] = a * (frame->xmax - frame->xmin);
+				v[1] = b * (frame->ymax - frame->ymin);
+				v[2] = c * (frame->zmax - frame->zmin);
+				offset = context->images.offset[k];
+				offset[0] = m[0][0] * v[0]
+						+ m[0][1] * v[1] + m[0][2] * v[2];
+				offset[1] = m[1][0] * v[0]
+						+ m[1][1] * v[1] + m[1][2] * v[2];
+				offset[2] = m[2][0] * v[0]
+						+ m[2][1] * v[1] + m[2][2] * v[2];
+				offset[3] = v[2];
+				ominx = MIN(ominx, offset[0]);
+				omaxx = MAX(omaxx, offset[0]);
+				ominy = MIN(ominy, offset[1]);
+				omaxy = MAX(omaxy, offset[1]);
+				ominz = MIN(ominz, offset[3]);
+				omaxz = MAX(omaxz, offset[3]);
+				omind = MIN(omind, offset[2]);
+				omaxd = MAX(omaxd, offset[2]);
+				k++;
+			}
+		}
+	}
+	context->images.num = k;
+	context->images.distance = config->perspDist;
+	context->images.zcenter = zcenter;
+
+	*minx += ominx;
+	*maxx += omaxx;
+	*miny += ominy;
+	*maxy += omaxy;
+	*minz += ominz;
+	*maxz += omaxz;
+	*mindepth += omind;
+	*maxdepth += omaxd;
+}
+
+/************************************************************************/
+/* Orders atoms by their distance along the slab normal.		*/
+/************************************************************************/
+static int compareSlabAtoms(const void *a, const void *b) {
+	const struct SlabAtom *sa = a, *sb = b;
+
+	return (sa->key > sb->key) - (sa->key < sb->key);
+}
+
+/************************************************************************/
+/* Returns the first of the atoms inside the slab in the sorted index,	*/
+/* and their number in count. The first time a frame is drawn the index	*/
+/* is not made and NULL is returned, the atoms are then tested one by	*/
+/* one. Only when the same frame is drawn again, as when it is rotated	*/
+/* or sliced, it is sorted so that the slab is found by binary search.	*/
+/************************************************************************/
+static struct SlabAtom * findSlabAtoms(struct SlabIndex *s,
+		struct Frame *frame, struct Configuration *config, gint *count) {
+	gint i, lo, hi, mid, first;
+	struct Atom *coords;
+	struct SlabAtom *atoms;
+
+	coords = frame->atomdata;
+
+	if (s->frame != frame || s->generation != frame->generation
+			|| s->numatoms != frame->numAtoms
+			|| s->normal[0] != config->slabNormal[0]
+			|| s->normal[1] != config->slabNormal[1]
+			|| s->normal[2] != config->slabNormal[2]) {
+		s->frame = frame;
+		s->generation = frame->generation;
+		s->numatoms = frame->numAtoms;
+		for (i = 0; i < 3; i++)
+			s->normal[i] = config->slabNormal[i];
+		s->sorted = FALSE;
+		return NULL;
+	}
+
+	atoms = (struct SlabAtom *) s->atoms.data;
+	if (!s->sorted) {
+		atoms = (struct SlabAtom *) growScratch(&(s->atoms),
+				s->numatoms * sizeof(struct SlabAtom));
+		for (i = 0; i < s->numatoms; i++) {
+			atoms[i].key = s->normal[0] * coords[i].xcoord
+					+ s->normal[1] * coords[i].ycoord
+					+ s->normal[2] * coords[i].zcoord;
+			atoms[i].index = i;
+		}
+		qsort(atoms, s->numatoms, sizeof(struct SlabAtom),
+				compareSlabAtoms);
+		s->sorted = TRUE;
+	}
+
+	lo = 0;
+	hi = s->numatoms;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (atoms[mid].key < config->slabMin)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	first = lo;
+	hi = s->numatoms;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (atoms[mid].key <= config->slabMax)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*count = lo - first;
+	return atoms + first;
+}
+
+/************************************************************************/
+/* Rotates the atoms first to last-1 of the transform into out, in one	*/
+/* pass that also interpolates them between frames and culls them by	*/
+/* slab, preview and camera. The depth is kept in tcoord for sorting,	*/
+/* zcoord is left as read or as interpolated. Returns the number of	*/
+/* atoms written to out.						*/
+/* The loop is scalar and reads and writes each atom once. Reading the	*/
+/* atoms is what it waits on, so splitting off a vectorized rotation	*/
+/* or culling without branches made it slower.				*/
+/************************************************************************/
+static gint transformAtoms(const struct Transform *t, gint first, gint last,
+		struct Atom *out) {
+	gint i, k, n;
+	double m00, m01, m02, m10, m11, m12, m20, m21, m22;
+	double cx, cy, cz, x, y, z, depth, key;
+	const struct Atom *coords, *from, *before;
+
+	/* Kept in locals so they stay in registers. */
+	m00 = t->m[0][0];
+	m01 = t->m[0][1];
+	m02 = t->m[0][2];
+	m10 = t->m[1][0];
+	m11 = t->m[1][1];
+	m12 = t->m[1][2];
+	m20 = t->m[2][0];
+	m21 = t->m[2][1];
+	m22 = t->m[2][2];
+	coords = t->coords;
+	from = t->from;
+	before = t->before;
+
+	n = 0;
+	for (k = first; k < last; k++) {
+		i = (t->slab != NULL) ? t->slab[k].index : k;
+		cx = coords[i].xcoord;
+		cy = coords[i].ycoord;
+		cz = coords[i].zcoord;
+		if (from != NULL) {
+			cx = t->w[2] * cx + t->w[1] * from[i].xcoord;
+			cy = t->w[2] * cy + t->w[1] * from[i].ycoord;
+			cz = t->w[2] * cz + t->w[1] * from[i].zcoord;
+			if (before != NULL) {
+				cx += t->w[0] * before[i].xcoord;
+				cy += t->w[0] * before[i].ycoord;
+				cz += t->w[0] * before[i].zcoord;
+			}
+		}
+		if (t->slabTest) {
+			key = t->slabNormal[0] * cx + t->slabNormal[1] * cy
+					+ t->slabNormal[2] * cz;
+			if (key < t->slabMin || key > t->slabMax)
+				continue;
+		}
+		if (t->keep != G_MAXUINT32 && (guint32) i * 2654435761u >= t->keep)
+			continue;
+
+		x = m00 * cx + m01 * cy + m02 * cz;
+		y = m10 * cx + m11 * cy + m12 * cz;
+		z = m20 * cx + m21 * cy + m22 * cz;
+		if (t->distance > 0.0) {
+			depth = t->distance - (z - t->zcenter);
+			if (depth < 0.01 * t->distance)
+				continue;
+			x = (x - t->xcenter) * (t->distance / depth);
+			y = (y - t->ycenter) * (t->distance / depth);
+		}
+
+		out[n].xcoord = x;
+		out[n].ycoord = y;
+		out[n].zcoord = cz;
+		out[n].tcoord = z;
+		out[n].atype = coords[i].atype;
+		out[n].index = i;
+		n++;
+	}
+
+	return n;
+}
+
+/************************************************************************/
+/* Rotates the packed atoms first to last-1 of the transform into out	*/
+/* like transformAtoms, but reads the coordinates as floats or 16 bit	*/
+/* steps and computes in floats. Their scale and origin are folded into	*/
+/* the rotation, so each atom costs the same as a double one while a	*/
+/* quarter or a fifth of the memory is read.				*/
+/************************************************************************/
+static gint transformPackedAtoms(const struct Transform *t, gint first,
+		gint last, struct Atom *out) {
+	gint i, k, n, atype;
+	float a00, a01, a02, a10, a11, a12, a20, a21, a22, b0, b1, b2;
+	float px, py, pz, x, y, z, depth, key, distance, zcenter;
+
+	/* Kept in locals so they stay in registers. */
+	a00 = t->a[0][0];
+	a01 = t->a[0][1];
+	a02 = t->a[0][2];
+	a10 = t->a[1][0];
+	a11 = t->a[1][1];
+	a12 = t->a[1][2];
+	a20 = t->a[2][0];
+	a21 = t->a[2][1];
+	a22 = t->a[2][2];
+	b0 = t->b[0];
+	b1 = t->b[1];
+	b2 = t->b[2];
+	distance = (float) t->distance;
+	zcenter = (float) t->zcenter;
+
+	n = 0;
+	for (k = first; k < last; k++) {
+		i = (t->slab != NULL) ? t->slab[k].index : k;
+		if (t->shorts != NULL) {
+			px = t->shorts[i].x;
+			py = t->shorts[i].y;
+			pz = t->shorts[i].z;
+			atype = t->shorts[i].atype;
+		} else {
+			px = t->floats[i].x;
+			py = t->floats[i].y;
+			pz = t->floats[i].z;
+			atype = t->floats[i].atype;
+		}
+		if (t->slabTest) {
+			key = t->slabKey[0] * px + t->slabKey[1] * py
+					+ t->slabKey[2] * pz + t->slabKey[3];
+			if (key < t->slabMin || key > t->slabMax)
+				continue;
+		}
+		if (t->keep != G_MAXUINT32 && (guint32) i * 2654435761u >= t->keep)
+			continue;
+
+		x = a00 * px + a01 * py + a02 * pz + b0;
+		y = a10 * px + a11 * py + a12 * pz + b1;
+		z = a20 * px + a21 * py + a22 * pz + b2;
+		if (distance > 0.0f) {
+			depth = distance - (z - zcenter);
+			if (depth < 0.01f * distance)
+				continue;
+			x *= distance / depth;
+			y *= distance / depth;
+		}
+
+		out[n].xcoord = x;
+		out[n].ycoord = y;
+		out[n].zcoord = t->zorigin + t->zscale * pz;
+		out[n].tcoord = z;
+		out[n].atype = atype;
+		out[n].index = i;
+		n++;
+	}
+
+	return n;
+}
+
+/************************************************************************/
+/* Sets up the transform to read the packed atoms of frame, folding	*/
+/* their scale and origin into the rotation and the slab normal. The	*/
+/* center of a perspective camera is taken off in the rotation too.	*/
+/************************************************************************/
+static void setupPackedTransform(struct Transform *t, struct Frame *frame) {
+	gint i, j;
+	double b, center[3];
+
+	t->floats = NULL;
+	t->shorts = NULL;
+	if (frame->packing == 32)
+		t->floats = (struct FloatAtom *) frame->packed;
+	else
+		t->shorts = (struct ShortAtom *) frame->packed;
+
+	center[0] = t->xcenter;
+	center[1] = t->ycenter;
+	center[2] = 0.0;
+	for (i = 0; i < 3; i++) {
+		b = -center[i];
+		for (j = 0; j < 3; j++) {
+			t->a[i][j] = (float) (t->m[i][j] * frame->packScale);
+			b += t->m[i][j] * frame->packOrigin[j];
+		}
+		t->b[i] = (float) b;
+	}
+	t->zorigin = (float) frame->packOrigin[2];
+	t->zscale = (float) frame->packScale;
+
+	b = 0.0;
+	for (j = 0; j < 3; j++) {
+		t->slabKey[j] = (float) (t->slabNormal[j] * frame->packScale);
+		b += t->slabNormal[j] * frame->packOrigin[j];
+	}
+	t->slabKey[3] = (float) b;
+}
+
+/************************************************************************/
+/* Transforms the atoms first to last-1 from the packed atoms if the	*/
+/* transform has them, else from the doubles.				*/
+/************************************************************************/
+static gint transformSlice(const struct Transform *t, gint first, gint last,
+		struct Atom *out) {
+	if (t->floats != NULL || t->shorts != NULL)
+		return transformPackedAtoms(t, first, last, out);
+	return transformAtoms(t, first, last, out);
+}
+
+/************************************************************************/
+/* Compares the atoms a rotated from packed coordinates with the atoms	*/
+/* b rotated from the doubles, byindex is room for numatoms atoms. The	*/
+/* largest differences in x, y and depth are returned in error, and the	*/
+/* number of atoms kept by only one of them is returned.		*/
+/************************************************************************/
+static gint compareTransforms(struct Atom *a, gint n, struct Atom *b, gint nb,
+		struct Atom *byindex, gint numatoms, double *error) {
+	gint i, matched;
+	struct Atom *c;
+
+	for (i = 0; i < numatoms; i++)
+		byindex[i].index = -1;
+	for (i = 0; i < nb; i++)
+		byindex[b[i].index] = b[i];
+
+	error[0] = error[1] = error[2] = 0.0;
+	matched = 0;
+	for (i = 0; i < n; i++) {
+		c = &(byindex[a[i].index]);
+		if (c->index < 0)
+			continue;
+		error[0] = MAX(error[0], fabs(a[i].xcoord - c->xcoord));
+		error[1] = MAX(error[1], fabs(a[i].ycoord - c->ycoord));
+		error[2] = MAX(error[2], fabs(a[i].tcoord - c->tcoord));
+		matched++;
+	}
+	return (n - matched) + (nb - matched);
+}
+
+/************************************************************************/
+/* Transforms one slice of the atoms.					*/
+/************************************************************************/
+static void transformPart(gint part, gint numparts, struct TransformJob *job) {
+	gint first, last;
+
+	first = (gint) ((gint64) job->numatoms * part / numparts);
+	last = (gint) ((gint64) job->numatoms * (part + 1) / numparts);
+
+	job->counts[part] = transformSlice(job->transform, first, last,
+			job->out + first);
+}
+
+/************************************************************************/
+/* Transforms the atoms 0..numatoms-1 into out over all workers, then	*/
+/* moves the kept atoms of each slice together in the order of the	*/
+/* slices so the result is the same as from one pass. Returns the	*/
+/* number of atoms kept.						*/
+/************************************************************************/
+static gint transformAtomsParallel(const struct Transform *t, gint numatoms,
+		struct Atom *out) {
+	gint i, n, first, numparts;
+	struct TransformJob job;
+
+	job.transform = t;
+	job.numatoms = numatoms;
+	job.out = out;
+
+	runParallel((void (*)(gint, gint, gpointer)) transformPart, &job);
+	numparts = getNumWorkers();
+
+	n = 0;
+	for (i = 0; i < numparts; i++) {
+		first = (gint) ((gint64) numatoms * i / numparts);
+		if (n != first && job.counts[i] > 0)
+			memmove(out + n, out + first, job.counts[i] * sizeof(struct Atom));
+		n += job.counts[i];
+	}
+	return n;
+}
+
+/************************************************************************/
+/* Returns TRUE if the atoms held in cache were rotated from the same	*/
+/* frame, in the current orientation and with the same settings.	*/
+/************************************************************************/
+static gboolean matchTransformCache(struct TransformCache *cache,
+		double rotation[3][3], struct Frame *frame,
+		struct Configuration *config, gint order) {
+	gint i, j;
+
+	if (cache->frame != frame || cache->generation != frame->generation
+			|| cache->numatoms != frame->numAtoms)
+		return FALSE;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			if (cache->m[i][j] != rotation[i][j])
+				return FALSE;
+	if (cache->slab != config->slab || cache->perspDist != config->perspDist
+			|| cache->order != order)
+		return FALSE;
+	if (config->slab) {
+		for (i = 0; i < 3; i++)
+			if (cache->slabNormal[i] != config->slabNormal[i])
+				return FALSE;
+		if (cache->slabMin != config->slabMin
+				|| cache->slabMax != config->slabMax)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/************************************************************************/
+/* Stores what the atoms in cache were rotated from.			*/
+/************************************************************************/
+static void storeTransformCache(struct TransformCache *cache,
+		double rotation[3][3], struct Frame *frame,
+		struct Configuration *config, gint order) {
+	gint i, j;
+
+	cache->frame = frame;
+	cache->generation = frame->generation;
+	cache->numatoms = frame->numAtoms;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			cache->m[i][j] = rotation[i][j];
+	cache->slab = config->slab;
+	for (i = 0; i < 3; i++)
+		cache->slabNormal[i] = config->slabNormal[i];
+	cache->slabMin = config->slabMin;
+	cache->slabMax = config->slabMax;
+	cache->perspDist = config->perspDist;
+	cache->order = order;
+}
+
+/************************************************************************/
+/* Adds the range in z of a frame times the weight w to the range	*/
+/* minz..maxz, which then holds every weighted sum of z of the frames.	*/
+/************************************************************************/
+static void addRange(double w, struct Frame *frame, double *minz,
+		double *maxz) {
+	if (w >= 0.0) {
+		*minz += w * frame->zmin;
+		*maxz += w * frame->zmax;
+	} else {
+		*minz += w * frame->zmax;
+		*maxz += w * frame->zmin;
+	}
+}
+
 /************************************************************************/
 /* This function rotates the coordinates of the atoms, sorts them and	*/
-/* calls the drawcircles to draw them.									*/
+/* calls the drawcircles to draw them. While a preview is drawn only a	*/
+/* part of the atoms small enough to be drawn within config->lod ms is	*/
+/* rotated, the number of rotated atoms is returned in numrotated.	*/
+/* The rotated atoms are held in context->transform and are reused	*/
+/* while the frame and orientation stay the same, they must not be	*/
+/* freed or changed by the caller. The atoms are drawn with config,	*/
+/* which is the configuration of the context or one made from it. The	*/
+/* volume they are drawn in is returned in extent, the frame itself is	*/
+/* not changed so that every view can rotate it its own way.		*/
 /************************************************************************/
-struct Atom * rotateAtoms(struct Context *context) {
-	gint i, j, numatoms;
+struct Atom * rotateAtoms(struct Context *context,
+		struct Configuration *config, struct Extent *extent, gint *numrotated) {
+	gint i, j, n, numatoms, numslab, order;
+	guint32 keep;
+	double xcenter, ycenter, zcenter, halfwidth;
+	double sx, sy, sz, x, y, z, radius, error[3];
+	gint nc, differ;
+	gboolean packed, checked;
+	struct Frame *frame, *from, *before;
+	struct SlabAtom *slab;
+	struct Transform transform;
+	struct TransformCache *cache;
+	double (*rotation)[3];
 
 	double isin, icos, jsin, jcos, ksin, kcos;
-	double maxx, minx, maxy, miny, maxz, minz;
+	double maxx, minx, maxy, miny, maxz, minz, maxdepth, mindepth;
 	double imsin, imcos, jmsin, jmcos;
-	double ictmp[3];
-	double newic[3][3];
+	double newic[3][3], camera[3][3], m[3][3], v[3], w[3];
 
-	struct Atom *newcoords;
+	struct Atom *newcoords, *check;
 	struct Atom *coords;
-	struct Configuration *config;
 
-	config = context->config;
+	checked = FALSE;
+	rotation = context->rotation;
 
 	coords = (context->currentFrame)->atomdata;
 	numatoms = (context->currentFrame)->numAtoms;
 
-	minx = 0.0;
-	maxx = 0.0;
-	miny = 0.0;
-	maxy = 0.0;
-	minz = 0.0;
-	maxz = 0.0;
 	isin = sin(context->iangle * (-PI / 180.0));
 	icos = cos(context->iangle * (-PI / 180.0));
 	jsin = sin(context->jangle * (PI / 180.0));
@@ -120,57 +646,209 @@ struct Atom * rotateAtoms(struct Context *context) {
 	jmsin = sin(context->imangle * (-PI / 180.0));
 	jmcos = cos(context->imangle * (-PI / 180.0));
 
-	newcoords = (struct Atom *) g_malloc(numatoms * sizeof(struct Atom));
-
 	for (i = 0; i < 3; i++)
-		newic[0][i] = rotationVector[0][i] * jcos * kcos + rotationVector[1][i] * (-jcos * ksin)
-				+ rotationVector[2][i] * jsin;
+		newic[0][i] = rotation[0][i] * jcos * kcos + rotation[1][i] * (-jcos * ksin)
+				+ rotation[2][i] * jsin;
 	for (i = 0; i < 3; i++)
-		newic[1][i] = rotationVector[0][i] * (isin * jsin * kcos + icos * ksin)
-				+ rotationVector[1][i] * (-isin * jsin * ksin + icos * kcos)
-				+ rotationVector[2][i] * (-isin * jcos);
+		newic[1][i] = rotation[0][i] * (isin * jsin * kcos + icos * ksin)
+				+ rotation[1][i] * (-isin * jsin * ksin + icos * kcos)
+				+ rotation[2][i] * (-isin * jcos);
 	for (i = 0; i < 3; i++)
-		newic[2][i] = rotationVector[0][i] * (-icos * jsin * kcos + isin * ksin)
-				+ rotationVector[1][i] * (icos * jsin * ksin + isin * kcos)
-				+ rotationVector[2][i] * icos * jcos;
+		newic[2][i] = rotation[0][i] * (-icos * jsin * kcos + isin * ksin)
+				+ rotation[1][i] * (icos * jsin * ksin + isin * kcos)
+				+ rotation[2][i] * icos * jcos;
 	for (i = 0; i < 3; i++)
 		for (j = 0; j < 3; j++)
-			rotationVector[i][j] = newic[i][j];
+			rotation[i][j] = newic[i][j];
 
 	for (i = 0; i < 3; i++)
-		newic[0][i] = rotationVector[0][i] * jmcos + rotationVector[2][i] * jmsin;
+		newic[0][i] = rotation[0][i] * jmcos + rotation[2][i] * jmsin;
 	for (i = 0; i < 3; i++)
-		newic[1][i] = rotationVector[0][i] * imsin * jmsin + rotationVector[1][i] * imcos
-				+ rotationVector[2][i] * (-imsin * jmcos);
+		newic[1][i] = rotation[0][i] * imsin * jmsin + rotation[1][i] * imcos
+				+ rotation[2][i] * (-imsin * jmcos);
 	for (i = 0; i < 3; i++)
-		newic[2][i] = rotationVector[0][i] * (-imcos * jmsin) + rotationVector[1][i] * imsin
-				+ rotationVector[2][i] * imcos * jmcos;
+		newic[2][i] = rotation[0][i] * (-imcos * jmsin) + rotation[1][i] * imsin
+				+ rotation[2][i] * imcos * jmcos;
 	for (i = 0; i < 3; i++)
 		for (j = 0; j < 3; j++)
-			rotationVector[i][j] = newic[i][j];
-
-	for (i = 0; i < numatoms; i++) {
-		newcoords[i].xcoord = rotationVector[0][0] * coords[i].xcoord
-				+ rotationVector[0][1] * coords[i].ycoord + rotationVector[0][2] * coords[i].zcoord;
-		newcoords[i].ycoord = rotationVector[1][0] * coords[i].xcoord
-				+ rotationVector[1][1] * coords[i].ycoord + rotationVector[1][2] * coords[i].zcoord;
-		newcoords[i].zcoord = rotationVector[2][0] * coords[i].xcoord
-				+ rotationVector[2][1] * coords[i].ycoord + rotationVector[2][2] * coords[i].zcoord;
-		newcoords[i].atype = coords[i].atype;
-		newcoords[i].index = i;
-		if (newcoords[i].xcoord > maxx)
-			maxx = newcoords[i].xcoord;
-		if (newcoords[i].ycoord > maxy)
-			maxy = newcoords[i].ycoord;
-		if (newcoords[i].zcoord > maxz)
-			maxz = newcoords[i].zcoord;
-		if (newcoords[i].xcoord < minx)
-			minx = newcoords[i].xcoord;
-		if (newcoords[i].ycoord < miny)
-			miny = newcoords[i].ycoord;
-		if (newcoords[i].zcoord < minz)
-			minz = newcoords[i].zcoord;
+			rotation[i][j] = newic[i][j];
+
+	/* A camera path turns the view before the rotations of the user. */
+	if (config->numCameraKeys > 0) {
+		getCameraRotation(config, (double) getShownFrameNumber(context)
+				/ (context->owner->config->interpolate + 1), camera);
+		for (i = 0; i < 3; i++)
+			for (j = 0; j < 3; j++)
+				m[i][j] = rotation[i][0] * camera[0][j]
+						+ rotation[i][1] * camera[1][j] + rotation[i][2] * camera[2][j];
+	} else {
+		for (i = 0; i < 3; i++)
+			for (j = 0; j < 3; j++)
+				m[i][j] = rotation[i][j];
+	}
+
+	/* A perspective camera looks at the center of the frame. */
+	frame = context->currentFrame;
+	xcenter = ycenter = zcenter = 0.0;
+	if (config->perspDist > 0.0) {
+		v[0] = 0.5 * (frame->xmin + frame->xmax);
+		v[1] = 0.5 * (frame->ymin + frame->ymax);
+		v[2] = 0.5 * (frame->zmin + frame->zmax);
+		xcenter = m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2];
+		ycenter = m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2];
+		zcenter = m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2];
+	}
+	extent->zcenter = zcenter;
+
+	/* The depth buffer and density map make the drawing order irrelevant. */
+	if (config->zbuffer || config->density)
+		order = 0;
+	else if (config->sort == 2)
+		order = 2;
+	else
+		order = 1;
+
+	/* A step between two frames is drawn from both of them. */
+	from = getInterpolation(context, &before, w);
+
+	/* Previews change with the drawing time and steps between frames
+	 are drawn once, so they are never reused. */
+	cache = &(context->transform);
+	cache->hit = !context->preview && from == NULL
+			&& matchTransformCache(cache, m, frame, config, order);
+
+	if (!cache->hit) {
+		/* With a slab only the atoms inside it are rotated, taken from
+		 the sorted index when the frame has one. The index holds the
+		 atoms as read, so interpolated atoms are tested one by one. */
+		slab = NULL;
+		numslab = numatoms;
+		if (config->slab && from == NULL) {
+			slab = findSlabAtoms(&(context->slab), frame, config,
+					&numslab);
+			if (slab == NULL)
+				numslab = numatoms;
+		}
+
+		newcoords = (struct Atom *) growScratch(&(cache->atoms),
+				numslab * sizeof(struct Atom));
+
+		/* Atoms are kept if a hash of their index is below keep, so that
+		 the same atoms are shown in every preview. */
+		keep = G_MAXUINT32;
+		if (context->preview && context->atomDrawTime > 0.0
+				&& context->atomDrawTime * numslab > config->lod)
+			keep = (guint32) (G_MAXUINT32
+					* (config->lod / (context->atomDrawTime * numslab)));
+
+		transform.coords = coords;
+		transform.from = (from != NULL) ? from->atomdata : NULL;
+		transform.before = (before != NULL) ? before->atomdata : NULL;
+		for (i = 0; i < 3; i++)
+			transform.w[i] = w[i];
+		transform.slab = slab;
+		transform.slabTest = config->slab && slab == NULL;
+		for (i = 0; i < 3; i++)
+			transform.slabNormal[i] = config->slabNormal[i];
+		transform.slabMin = config->slabMin;
+		transform.slabMax = config->slabMax;
+		transform.keep = keep;
+		for (i = 0; i < 3; i++)
+			for (j = 0; j < 3; j++)
+				transform.m[i][j] = m[i][j];
+		transform.xcenter = xcenter;
+		transform.ycenter = ycenter;
+		transform.zcenter = zcenter;
+		transform.distance = config->perspDist;
+
+		/* Steps between frames are blended from the doubles. */
+		packed = frame->packing != 0 && from == NULL;
+		transform.floats = NULL;
+		transform.shorts = NULL;
+		if (packed)
+			setupPackedTransform(&transform, frame);
+
+		/* Large frames are split over the workers, for small ones starting
+		 them costs more than it saves. */
+		if (numslab >= PARALLELATOMS && getNumWorkers() > 1)
+			n = transformAtomsParallel(&transform, numslab, newcoords);
+		else
+			n = transformSlice(&transform, 0, numslab, newcoords);
+
+		/* The atoms rotated with less precision are checked against the
+		 doubles they were packed from. */
+		checked = packed && config->validate;
+		if (checked) {
+			check = (struct Atom *) growScratch(&(cache->check),
+					(numslab + numatoms) * sizeof(struct Atom));
+			transform.floats = NULL;
+			transform.shorts = NULL;
+			nc = transformAtoms(&transform, 0, numslab, check);
+			differ = compareTransforms(newcoords, n, check, nc,
+					check + numslab, numatoms, error);
+		}
+
+		if (order == 2)
+			sortatoms(newcoords, 0, n - 1, FALSE);
+		else if (order == 1)
+			sortatoms(newcoords, 0, n - 1, TRUE);
+
+		cache->num = n;
+		/* Only all of the atoms of a frame as read are kept for reuse. */
+		if (keep == G_MAXUINT32 && from == NULL)
+			storeTransformCache(cache, m, frame, config, order);
+		else
+			cache->frame = NULL;
+	}
+
+	/* The atoms are inside the sphere found when the frame was read, so
+	 its rotated extent bounds them in x, y and depth in every orientation
+	 and the scale stays the same while the frame is rotated. A step
+	 between frames is inside the spheres of the frames blended with the
+	 same weights. */
+	sx = frame->centroidx;
+	sy = frame->centroidy;
+	sz = frame->centroidz;
+	radius = frame->radius;
+	if (from != NULL) {
+		sx = w[2] * sx + w[1] * from->centroidx;
+		sy = w[2] * sy + w[1] * from->centroidy;
+		sz = w[2] * sz + w[1] * from->centroidz;
+		radius = fabs(w[2]) * radius + fabs(w[1]) * from->radius;
+		if (before != NULL) {
+			sx += w[0] * before->centroidx;
+			sy += w[0] * before->centroidy;
+			sz += w[0] * before->centroidz;
+			radius += fabs(w[0]) * before->radius;
+		}
+	}
+	x = m[0][0] * sx + m[0][1] * sy + m[0][2] * sz;
+	y = m[1][0] * sx + m[1][1] * sy + m[1][2] * sz;
+	z = m[2][0] * sx + m[2][1] * sy + m[2][2] * sz;
+	minx = x - radius;
+	maxx = x + radius;
+	miny = y - radius;
+	maxy = y + radius;
+	mindepth = z - radius;
+	maxdepth = z + radius;
+
+	/* The atoms are colored and clipped by their z as read, so the range
+	 in z is the one the reader found, whatever the orientation. */
+	minz = frame->zmin;
+	maxz = frame->zmax;
+	if (from != NULL) {
+		minz = maxz = 0.0;
+		addRange(w[2], frame, &minz, &maxz);
+		addRange(w[1], from, &minz, &maxz);
+		if (before != NULL)
+			addRange(w[0], before, &minz, &maxz);
 	}
+	*numrotated = cache->num;
+
+	setupImages(context, config, m, zcenter, &minx, &maxx, &miny, &maxy,
+			&minz, &maxz, &mindepth, &maxdepth);
+	extent->depthmin = mindepth;
+	extent->depthmax = maxdepth;
 
 	context->iangle = 0.0;
 	context->jangle = 0.0;
@@ -178,94 +856,115 @@ struct Atom * rotateAtoms(struct Context *context) {
 	context->imangle = 0.0;
 	context->jmangle = 0.0;
 
-	if (rotationVector[0][0] != 0.0)
-		config->zc = atan(rotationVector[0][1] / rotationVector[0][0]) * (180.0 / PI);
-	else
-		config->zc = 0.0;
-	if (rotationVector[0][0] < 0.0 && rotationVector[0][1] > 0.0)
-		config->zc += 180;
-	else if (rotationVector[0][0] < 0.0 && rotationVector[0][1] < 0.0)
-		config->zc += 180;
-	else if (rotationVector[0][0] > 0.0 && rotationVector[0][1] < 0.0)
-		config->zc += 360;
-
-	ictmp[0] = rotationVector[2][0] * cos(-config->zc * (PI / 180.0))
-			- rotationVector[2][1] * sin(-config->zc * (PI / 180.0));
-
-	if (rotationVector[2][2] != 0.0)
-		config->yc = atan(-ictmp[0] / rotationVector[2][2]) * (180.0 / PI);
-	else
-		config->yc = 0.0;
-	if (rotationVector[2][2] < 0.0 && ictmp[0] > 0.0)
-		config->yc += 180;
-	else if (rotationVector[2][2] < 0.0 && ictmp[0] < 0.0)
-		config->yc += 180;
-	else if (rotationVector[2][2] > 0.0 && ictmp[0] < 0.0)
-		config->yc += 360;
-
-	ictmp[0] = rotationVector[1][0] * cos(-config->zc * (PI / 180.0))
-			- rotationVector[1][1] * sin(-config->zc * (PI / 180.0));
-	ictmp[1] = rotationVector[1][0] * sin(-config->zc * (PI / 180.0))
-			+ rotationVector[1][1] * cos(-config->zc * (PI / 180.0));
-	ictmp[2] = ictmp[0] * sin(-config->yc * (PI / 180.0))
-			+ rotationVector[1][2] * cos(-config->yc * (PI / 180.0));
-
-	if (ictmp[1] != 0.0)
-		config->xc = atan(ictmp[2] / ictmp[1]) * (180.0 / PI);
-	else
-		config->xc = 0.0;
-	if (ictmp[1] < 0.0 && ictmp[2] > 0.0)
-		config->xc += 180;
-	else if (ictmp[1] < 0.0 && ictmp[2] < 0.0)
-		config->xc += 180;
-	else if (ictmp[1] > 0.0 && ictmp[2] < 0.0)
-		config->xc += 360;
-
-	if (config->xc <= 0.0)
-		config->xc += 360.0;
-	if (config->xc >= 360.0)
-		config->xc -= 360.0;
-	if (config->yc <= 0.0)
-		config->yc += 360.0;
-	if (config->yc >= 360.0)
-		config->yc -= 360.0;
-	if (config->zc <= 0.0)
-		config->zc += 360.0;
-	if (config->zc >= 360.0)
-		config->zc -= 360.0;
-
-	if (config->sort == 2) {
-		sortatoms(newcoords, 0, numatoms - 1, FALSE);
-	} else
-		sortatoms(newcoords, 0, numatoms - 1, TRUE);
-
-	for (i = 0; i < numatoms; i++) {
-		newcoords[i].zcoord = coords[newcoords[i].index].zcoord;
-	}
-
 	if (config->xmin == 65535.0) {
-		(context->currentFrame)->xmax = maxx;
-		(context->currentFrame)->xmin = minx;
+		extent->xmax = maxx;
+		extent->xmin = minx;
 	} else {
-		(context->currentFrame)->xmax = config->xmax;
-		(context->currentFrame)->xmin = config->xmin;
+		extent->xmax = config->xmax;
+		extent->xmin = config->xmin;
 	}
 	if (config->ymin == 65535.0) {
-		(context->currentFrame)->ymax = maxy;
-		(context->currentFrame)->ymin = miny;
+		extent->ymax = maxy;
+		extent->ymin = miny;
 	} else {
-		(context->currentFrame)->ymax = config->ymax;
-		(context->currentFrame)->ymin = config->ymin;
+		extent->ymax = config->ymax;
+		extent->ymin = config->ymin;
 	}
 	if (config->zmin == 65535.0) {
-		(context->currentFrame)->zmax = maxz;
-		(context->currentFrame)->zmin = minz;
+		extent->zmax = maxz;
+		extent->zmin = minz;
 	} else {
-		(context->currentFrame)->zmax = config->zmax;
-		(context->currentFrame)->zmin = config->zmin;
+		extent->zmax = config->zmax;
+		extent->zmin = config->zmin;
+	}
+
+	/* The view of a perspective camera replaces the bounds in x and y. */
+	if (config->perspDist > 0.0) {
+		halfwidth = config->perspDist * tan(config->perspFov * (PI / 360.0));
+		extent->xmin = -halfwidth;
+		extent->xmax = halfwidth;
+		extent->ymin = -halfwidth * config->absysize / config->absxsize;
+		extent->ymax = halfwidth * config->absysize / config->absxsize;
 	}
 
-	return newcoords;
+	if (checked)
+		printf("Frame %d: %d bit transform, largest difference %.4f x %.4f "
+				"pixels and %.4g in depth, %d atoms kept differently\n",
+				frame->numframe, frame->packing,
+				error[0] * config->absxsize / MAX(extent->xmax - extent->xmin, 1e-9),
+				error[1] * config->absysize / MAX(extent->ymax - extent->ymin, 1e-9),
+				error[2], differ);
+
+	return (struct Atom *) cache->atoms.data;
+}
+
+
+/************************************************************************/
+/* Computes the angles of the orientation of the view around x, y and z	*/
+/* for showing them, only done when they are shown.			*/
+/************************************************************************/
+void getViewAngles(struct Context *context, double *xc, double *yc,
+		double *zc) {
+	double ictmp[3];
+	double (*rotation)[3];
+
+	rotation = context->rotation;
+
+	if (rotation[0][0] != 0.0)
+		*zc = atan(rotation[0][1] / rotation[0][0]) * (180.0 / PI);
+	else
+		*zc = 0.0;
+	if (rotation[0][0] < 0.0 && rotation[0][1] > 0.0)
+		*zc += 180;
+	else if (rotation[0][0] < 0.0 && rotation[0][1] < 0.0)
+		*zc += 180;
+	else if (rotation[0][0] > 0.0 && rotation[0][1] < 0.0)
+		*zc += 360;
+
+	ictmp[0] = rotation[2][0] * cos(-*zc * (PI / 180.0))
+			- rotation[2][1] * sin(-*zc * (PI / 180.0));
+
+	if (rotation[2][2] != 0.0)
+		*yc = atan(-ictmp[0] / rotation[2][2]) * (180.0 / PI);
+	else
+		*yc = 0.0;
+	if (rotation[2][2] < 0.0 && ictmp[0] > 0.0)
+		*yc += 180;
+	else if (rotation[2][2] < 0.0 && ictmp[0] < 0.0)
+		*yc += 180;
+	else if (rotation[2][2] > 0.0 && ictmp[0] < 0.0)
+		*yc += 360;
+
+	ictmp[0] = rotation[1][0] * cos(-*zc * (PI / 180.0))
+			- rotation[1][1] * sin(-*zc * (PI / 180.0));
+	ictmp[1] = rotation[1][0] * sin(-*zc * (PI / 180.0))
+			+ rotation[1][1] * cos(-*zc * (PI / 180.0));
+	ictmp[2] = ictmp[0] * sin(-*yc * (PI / 180.0))
+			+ rotation[1][2] * cos(-*yc * (PI / 180.0));
+
+	if (ictmp[1] != 0.0)
+		*xc = atan(ictmp[2] / ictmp[1]) * (180.0 / PI);
+	else
+		*xc = 0.0;
+	if (ictmp[1] < 0.0 && ictmp[2] > 0.0)
+		*xc += 180;
+	else if (ictmp[1] < 0.0 && ictmp[2] < 0.0)
+		*xc += 180;
+	else if (ictmp[1] > 0.0 && ictmp[2] < 0.0)
+		*xc += 360;
+
+	if (*xc <= 0.0)
+		*xc += 360.0;
+	if (*xc >= 360.0)
+		*xc -= 360.0;
+	if (*yc <= 0.0)
+		*yc += 360.0;
+	if (*yc >= 360.0)
+		*yc -= 360.0;
+	if (*zc <= 0.0)
+		*zc += 360.0;
+	if (*zc >= 360.0)
+		*zc -= 360.0;
 }
 
 
@@ -273,18 +972,18 @@ struct Atom * rotateAtoms(struct Context *context) {
 /* This function resets the orientation of the system by reseting the 	*/
 /* vector that handles the rotation.									*/
 /************************************************************************/
-void resetOrientation() {
+void resetOrientation(struct Context *context) {
 	const static double x_vector[3] = X_VECTOR;
 	const static double y_vector[3] = Y_VECTOR;
 	const static double z_vector[3] = Z_VECTOR;
 
-	rotationVector[0][0] = x_vector[0];
-	rotationVector[0][1] = x_vector[1];
-	rotationVector[0][2] = x_vector[2];
-	rotationVector[1][0] = y_vector[0];
-	rotationVector[1][1] = y_vector[1];
-	rotationVector[1][2] = y_vector[2];
-	rotationVector[2][0] = z_vector[0];
-	rotationVector[2][1] = z_vector[1];
-	rotationVector[2][2] = z_vector[2];
+	context->rotation[0][0] = x_vector[0];
+	context->rotation[0][1] = x_vector[1];
+	context->rotation[0][2] = x_vector[2];
+	context->rotation[1][0] = y_vector[0];
+	context->rotation[1][1] = y_vector[1];
+	context->rotation[1][2] = y_vector[2];
+	context->rotation[2][0] = z_vector[0];
+	context->rotation[2][1] = z_vector[1];
+	context->rotation[2][2] = z_vector[2];
 }
@@ -25,6 +25,7 @@
 
 #include <gtk/gtk.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "parameters.h"
 #include "tooltips.h"
@@ -183,6 +184,8 @@ struct Configuration * getNewConfigurationFromSetup(struct Context *context) {
 	newconfig->sort = setupConfig.sort;
 	newconfig->tifjpg = setupConfig.tifjpg;
 	newconfig->useTypesForColoring = setupConfig.useTypesForColoring;
+	newconfig->zbuffer = setupConfig.zbuffer;
+	newconfig->cull = setupConfig.cull;
 
 	return newconfig;
 }
@@ -199,7 +202,8 @@ void okeyPressed(GtkWidget *widget, struct Context *context) {
 
 	if (!context->StartedAlready) {
 		context->config = newconfig;
-		StartEverything(context);
+		if (!StartEverything(context))
+			exit(-1);
 	} else {
 		setupStartOk(context, newconfig);
 	}
@@ -441,6 +445,20 @@ void toggle_sortr(GtkToggleButton *widget, gpointer data) {
 	}
 }
 
+/************************************************************************/
+/* This function is called when the depth buffer checkbutton is pressed.*/
+/************************************************************************/
+void toggle_zbuffer(GtkToggleButton *widget, gpointer data) {
+	setupConfig.zbuffer = gtk_toggle_button_get_active(widget);
+}
+
+/************************************************************************/
+/* This function is called when the cull checkbutton is pressed.	*/
+/************************************************************************/
+void toggle_cull(GtkToggleButton *widget, gpointer data) {
+	setupConfig.cull = gtk_toggle_button_get_active(widget);
+}
+
 /************************************************************************/
 /* This function is called when the stringsearch checkbutton is 	*/
 /* pressed. It also activates the string entry and the other related 	*/
@@ -509,7 +527,8 @@ void setspinlimits(GtkWidget *widget, gpointer data) {
 /************************************************************************/
 void showSetupWindow(struct Context *context) {
 	GtkWidget *browseb, *cancelButton, *applyButton, *quitButton, *check, *erasetoggle,
-			*whitetoggle, *dumpcheck, *sortrtoggle;
+			*whitetoggle, *dumpcheck, *sortrtoggle, *zbuffertoggle,
+			*culltoggle;
 	GtkWidget *dumptifcheck, *dumpjpgcheck;
 	GtkWidget *vbox_main, *hbox_main, *vbox, *hbox1, *hbox2, *hbox3, *vboxright,
 			*vboxmostright, *vboxleft, *hboxcube;
@@ -535,6 +554,8 @@ void showSetupWindow(struct Context *context) {
 	setupConfig.tifjpg = context->config->tifjpg;
 	setupConfig.dumpnum = context->config->dumpnum;
 	setupConfig.useTypesForColoring = context->config->useTypesForColoring;
+	setupConfig.zbuffer = context->config->zbuffer;
+	setupConfig.cull = context->config->cull;
 
 	usedump = FALSE;
 	usescol = FALSE;
@@ -1010,6 +1031,21 @@ void showSetupWindow(struct Context *context) {
 	if (context->config->sort == 2)
 		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (sortrtoggle), TRUE);
 
+	zbuffertoggle = gtk_check_button_new_with_label(
+			" Use depth buffer instead of sorting");
+	g_signal_connect(G_OBJECT (zbuffertoggle), "toggled",
+			G_CALLBACK (toggle_zbuffer), G_OBJECT (setupwin));
+	gtk_box_pack_start(GTK_BOX (vboxmostright), zbuffertoggle, TRUE, TRUE, 0);
+	if (context->config->zbuffer)
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (zbuffertoggle), TRUE);
+
+	culltoggle = gtk_check_button_new_with_label(" Skip hidden atoms");
+	g_signal_connect(G_OBJECT (culltoggle), "toggled",
+			G_CALLBACK (toggle_cull), G_OBJECT (setupwin));
+	gtk_box_pack_start(GTK_BOX (vboxmostright), culltoggle, TRUE, TRUE, 0);
+	if (context->config->cull)
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON (culltoggle), TRUE);
+
 	sleep_label = gtk_label_new("Delay between frames [s] : ");
 
 	adjsleep = (GtkAdjustment *) gtk_adjustment_new((context->config->interval / 1000.0),
@@ -49,6 +49,10 @@ gint tmp2;
     coords[i].zcoord = coords[j].zcoord; 
     coords[j].zcoord = tmp;
 
+    tmp = coords[i].tcoord; 
+    coords[i].tcoord = coords[j].tcoord; 
+    coords[j].tcoord = tmp;
+
     tmp2 = coords[i].index; 
     coords[i].index = coords[j].index; 
     coords[j].index = tmp2;
@@ -61,11 +65,12 @@ gint tmp2;
 
 /************************************************************************/
 /* This function is used to compare two atoms coordinates to each other.*/
+/* The rotated depth in tcoord is compared first, then y and x.		*/
 /************************************************************************/
 gint compare3(struct Atom *coords,gint i,gint j)
 {
-    if (coords[i].zcoord < coords[j].zcoord) return (-1);
-    else if (coords[i].zcoord > coords[j].zcoord) return (1);
+    if (coords[i].tcoord < coords[j].tcoord) return (-1);
+    else if (coords[i].tcoord > coords[j].tcoord) return (1);
     else {
 	if (coords[i].ycoord < coords[j].ycoord) return (-1);
 	else if (coords[i].ycoord > coords[j].ycoord) return (1);
@@ -81,7 +86,7 @@ gint compare3(struct Atom *coords,gint i,gint j)
 /************************************************************************/
 /* This sorting function is a copy of the example in K&R C programming	*/
 /* 2nd ed. page 120. Some sort of quicksort.				*/
-/* It is used to sort the atoms by x,y and z coordinates.		*/
+/* It is used to sort the atoms by depth, y and x coordinates.		*/
 /************************************************************************/
 void sortatoms(struct Atom *coords, gint left, gint right, gboolean sort) 
 {
@@ -0,0 +1,196 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include "parameters.h"
+
+/* The video being written, frames must all have the same size */
+static FILE *videofp = NULL;
+static gboolean videoPipe; /* Is the video piped to a command ? */
+static gint videoWidth, videoHeight;
+static guint8 *videoBuffer = NULL; /* One converted frame */
+
+/************************************************************************/
+/* Opens the video file or starts the command the frames are piped to,	*/
+/* videodump is the mode of config->videodump. The size of the frames	*/
+/* is taken from the first frame. Returns FALSE if the video can't be	*/
+/* opened.								*/
+/************************************************************************/
+static gboolean openVideo(gint videodump, const gchar *videoname, gint width,
+		gint height) {
+	videoWidth = width;
+	videoHeight = height;
+	videoPipe = (videodump == 2);
+
+	if (videoPipe) {
+		printf("Piping %dx%d rgb24 frames to: %s\n", width, height,
+				videoname);
+		videofp = popen(videoname, "w");
+	} else
+		videofp = fopen(videoname, "wb");
+	if (videofp == NULL) {
+		printf("Error opening video: %s\n", videoname);
+		return FALSE;
+	}
+
+	if (videoPipe) {
+		videoBuffer = g_malloc(width * height * 3);
+	} else {
+		/* Chroma is subsampled 2x2, rounding odd sizes up. */
+		videoBuffer = g_malloc(
+				width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+		fprintf(videofp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width,
+				height, VIDEOFPS);
+	}
+	return TRUE;
+}
+
+/************************************************************************/
+/* Converts an image to the planar YCbCr 4:2:0 format of a y4m frame,	*/
+/* with the full range coefficients of JPEG.				*/
+/************************************************************************/
+static void convertToYUV(cairo_surface_t *image, guint8 *yuv) {
+	gint x, y, dx, dy, n, stride, cw, ch;
+	double r, g, b;
+	guint32 pixel;
+	guint8 *data, *cb, *cr;
+
+	data = cairo_image_surface_get_data(image);
+	stride = cairo_image_surface_get_stride(image);
+	cw = (videoWidth + 1) / 2;
+	ch = (videoHeight + 1) / 2;
+	cb = yuv + videoWidth * videoHeight;
+	cr = cb + cw * ch;
+
+	for (y = 0; y < videoHeight; y++) {
+		for (x = 0; x < videoWidth; x++) {
+			pixel = ((guint32 *) (data + y * stride))[x];
+			yuv[y * videoWidth + x] = (guint8) (0.299 * ((pixel >> 16) & 0xff)
+					+ 0.587 * ((pixel >> 8) & 0xff) + 0.114 * (pixel & 0xff)
+					+ 0.5);
+		}
+	}
+
+	for (y = 0; y < ch; y++) {
+		for (x = 0; x < cw; x++) {
+			r = g = b = 0.0;
+			n = 0;
+			for (dy = 0; dy < 2 && 2 * y + dy < videoHeight; dy++) {
+				for (dx = 0; dx < 2 && 2 * x + dx < videoWidth; dx++) {
+					pixel = ((guint32 *) (data + (2 * y + dy) * stride))[2 * x
+							+ dx];
+					r += (pixel >> 16) & 0xff;
+					g += (pixel >> 8) & 0xff;
+					b += pixel & 0xff;
+					n++;
+				}
+			}
+			r /= n;
+			g /= n;
+			b /= n;
+			cb[y * cw + x] = (guint8) CLAMP(
+					128.0 - 0.168736 * r - 0.331264 * g + 0.5 * b + 0.5, 0.0,
+					255.0);
+			cr[y * cw + x] = (guint8) CLAMP(
+					128.0 + 0.5 * r - 0.418688 * g - 0.081312 * b + 0.5, 0.0,
+					255.0);
+		}
+	}
+}
+
+/************************************************************************/
+/* Converts an image to packed rgb24 rows for piping to an encoder.	*/
+/************************************************************************/
+static void convertToRGB(cairo_surface_t *image, guint8 *rgb) {
+	gint x, y, stride;
+	guint32 pixel;
+	guint8 *data;
+
+	data = cairo_image_surface_get_data(image);
+	stride = cairo_image_surface_get_stride(image);
+
+	for (y = 0; y < videoHeight; y++) {
+		for (x = 0; x < videoWidth; x++) {
+			pixel = ((guint32 *) (data + y * stride))[x];
+			*rgb++ = (pixel >> 16) & 0xff;
+			*rgb++ = (pixel >> 8) & 0xff;
+			*rgb++ = pixel & 0xff;
+		}
+	}
+}
+
+/************************************************************************/
+/* Appends an image to the video, opening it on the first frame. Must	*/
+/* only be called from one thread at a time, in the order of the frames.*/
+/* The mode and name are passed by value rather than in the		*/
+/* configuration, which may be replaced while the frame is queued.	*/
+/************************************************************************/
+gboolean writeVideoFrame(gint videodump, const gchar *videoname,
+		cairo_surface_t *image) {
+	gint width, height;
+
+	width = cairo_image_surface_get_width(image);
+	height = cairo_image_surface_get_height(image);
+
+	if (videofp == NULL && videoBuffer == NULL) {
+		if (!openVideo(videodump, videoname, width, height))
+			videoBuffer = g_malloc(1);
+	}
+	if (videofp == NULL)
+		return FALSE;
+
+	if (width != videoWidth || height != videoHeight) {
+		printf("Frame size changed, skipping frame in video.\n");
+		return FALSE;
+	}
+
+	if (videoPipe) {
+		convertToRGB(image, videoBuffer);
+		fwrite(videoBuffer, 1, width * height * 3, videofp);
+	} else {
+		convertToYUV(image, videoBuffer);
+		fprintf(videofp, "FRAME\n");
+		fwrite(videoBuffer, 1,
+				width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2),
+				videofp);
+	}
+	return TRUE;
+}
+
+/************************************************************************/
+/* Finishes the video, waiting for a piped command to exit.		*/
+/************************************************************************/
+void closeVideo() {
+	if (videofp != NULL) {
+		if (videoPipe)
+			pclose(videofp);
+		else
+			fclose(videofp);
+		videofp = NULL;
+	}
+	g_free(videoBuffer);
+	videoBuffer = NULL;
+}
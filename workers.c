@@ -0,0 +1,136 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include "parameters.h"
+
+/* Structure describing one call of runParallel */
+struct ParallelJob {
+	void (*func)(gint part, gint numparts, gpointer data);
+	gpointer data;
+	gint numparts;
+	gint remaining; /* Number of parts not yet finished */
+	GMutex *lock;
+	GCond *done;
+};
+
+/* Structure describing one part of a job handed to the pool */
+struct ParallelPart {
+	struct ParallelJob *job;
+	gint part;
+};
+
+static GThreadPool *workerPool = NULL;
+static gint numWorkers = 1;
+
+/************************************************************************/
+/* This function is run by the pool threads, it runs one part of a job	*/
+/* and wakes up the caller of runParallel when all parts are done.	*/
+/************************************************************************/
+static void runPart(struct ParallelPart *part, gpointer unused) {
+	struct ParallelJob *job;
+
+	job = part->job;
+	job->func(part->part, job->numparts, job->data);
+
+	g_mutex_lock(job->lock);
+	job->remaining--;
+	if (job->remaining == 0)
+		g_cond_signal(job->done);
+	g_mutex_unlock(job->lock);
+}
+
+/************************************************************************/
+/* Creates the pool of worker threads shared by all parallel stages,	*/
+/* one thread for every processor of the machine.			*/
+/************************************************************************/
+void initWorkers() {
+	numWorkers = g_get_num_processors();
+	if (numWorkers > MAXWORKERS)
+		numWorkers = MAXWORKERS;
+	if (numWorkers < 1)
+		numWorkers = 1;
+
+	/* The calling thread runs one part itself. */
+	if (numWorkers > 1) {
+		workerPool = g_thread_pool_new((GFunc) runPart, NULL, numWorkers - 1,
+				TRUE, NULL);
+		if (workerPool == NULL) {
+			fprintf(stderr, "Creating worker threads failed.\n");
+			numWorkers = 1;
+		}
+	}
+
+#if Debug
+	printf("Using %d worker threads.\n", numWorkers);
+#endif
+}
+
+/************************************************************************/
+/* Returns the number of parts runParallel splits its work into.	*/
+/************************************************************************/
+gint getNumWorkers() {
+	return numWorkers;
+}
+
+/************************************************************************/
+/* Calls func once for every part 0..numparts-1 in parallel and returns	*/
+/* when all parts are done. Must not be called from inside func.	*/
+/************************************************************************/
+void runParallel(void (*func)(gint part, gint numparts, gpointer data),
+		gpointer data) {
+	struct ParallelJob job;
+	struct ParallelPart parts[MAXWORKERS];
+	gint i;
+
+	if (workerPool == NULL) {
+		func(0, 1, data);
+		return;
+	}
+
+	job.func = func;
+	job.data = data;
+	job.numparts = numWorkers;
+	job.remaining = numWorkers - 1;
+	job.lock = g_mutex_new();
+	job.done = g_cond_new();
+
+	for (i = 1; i < numWorkers; i++) {
+		parts[i].job = &job;
+		parts[i].part = i;
+		g_thread_pool_push(workerPool, &parts[i], NULL);
+	}
+
+	func(0, numWorkers, data);
+
+	g_mutex_lock(job.lock);
+	while (job.remaining > 0)
+		g_cond_wait(job.done, job.lock);
+	g_mutex_unlock(job.lock);
+
+	g_mutex_free(job.lock);
+	g_cond_free(job.done);
+}
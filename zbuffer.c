@@ -0,0 +1,210 @@
+/*
+
+ gdpc2 - a program for visualising molecular dynamic simulations
+ Copyright (C) 2012 Jonas Frantz
+
+ This file is a part of gdpc2.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+ Authors email: jonas@frantz.fi
+
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include "parameters.h"
+
+/************************************************************************/
+/* Packs a color into a pixel of a CAIRO_FORMAT_ARGB32 image surface.	*/
+/************************************************************************/
+guint32 packColor(double r, double g, double b) {
+	return 0xff000000 | ((guint32) (r * 255.0 + 0.5) << 16)
+			| ((guint32) (g * 255.0 + 0.5) << 8) | (guint32) (b * 255.0 + 0.5);
+}
+
+/************************************************************************/
+/* Evaluates the radial gradient of drawing mode 2 at the point (px,py)	*/
+/* the same way cairo does, by finding the largest t for which the	*/
+/* point lies on the circle interpolated between the start and end	*/
+/* circle. Returns FALSE if the gradient doesn't cover the point.	*/
+/************************************************************************/
+static gboolean shadeBall(double px, double py, gint x, gint y, gint r,
+		const double *color, guint32 *pixel) {
+	double c0x, c0y, r0, cdx, cdy, dr, pdx, pdy;
+	double a, b, c, disc, t, t1, t2, s;
+
+	c0x = x - r / 6.0;
+	c0y = y - r / 3.0;
+	r0 = r / 10.0;
+	cdx = (x - r / 3.0) - c0x;
+	cdy = 0.0;
+	dr = r * 1.67 - r0;
+	pdx = px - c0x;
+	pdy = py - c0y;
+
+	a = cdx * cdx + cdy * cdy - dr * dr;
+	b = pdx * cdx + pdy * cdy + r0 * dr;
+	c = pdx * pdx + pdy * pdy - r0 * r0;
+
+	if (a == 0.0) {
+		if (b == 0.0)
+			return FALSE;
+		t = c / (2.0 * b);
+		if (r0 + t * dr < 0.0)
+			return FALSE;
+	} else {
+		disc = b * b - a * c;
+		if (disc < 0.0)
+			return FALSE;
+		t1 = (b + sqrt(disc)) / a;
+		t2 = (b - sqrt(disc)) / a;
+		if (t2 > t1) {
+			t = t1;
+			t1 = t2;
+			t2 = t;
+		}
+		if (r0 + t1 * dr >= 0.0)
+			t = t1;
+		else if (r0 + t2 * dr >= 0.0)
+			t = t2;
+		else
+			return FALSE;
+	}
+
+	/* Color stops are white at 0, color at 0.2 and 0.2*color at 1. */
+	if (t <= 0.0)
+		*pixel = packColor(1.0, 1.0, 1.0);
+	else if (t < 0.2) {
+		s = t / 0.2;
+		*pixel = packColor(1.0 + s * (color[0] - 1.0),
+				1.0 + s * (color[1] - 1.0), 1.0 + s * (color[2] - 1.0));
+	} else if (t < 1.0) {
+		s = 1.0 - 0.8 * (t - 0.2) / 0.8;
+		*pixel = packColor(s * color[0], s * color[1], s * color[2]);
+	} else
+		*pixel = packColor(0.2 * color[0], 0.2 * color[1], 0.2 * color[2]);
+
+	return TRUE;
+}
+
+/************************************************************************/
+/* Draws the atoms with a per pixel depth test instead of relying on	*/
+/* the order of the atoms, so the coordinates don't need to be sorted.	*/
+/* Every pixel keeps the depth of the nearest atom written to it, and	*/
+/* an atom only overwrites pixels where it is nearer to the viewer.	*/
+/* For opaque atoms this gives the same image as painting the sorted	*/
+/* atoms, apart from the antialiased edges cairo would draw. The depths	*/
+/* and the image are held in buffers, the atoms seen are marked in pick	*/
+/* if it isn't NULL.							*/
+/************************************************************************/
+void drawAtomsZBuffer(cairo_t *cr, struct Extent *extent, struct Atom *coords,
+		gint numatoms, struct Configuration *config,
+		struct DrawBuffers *buffers, struct PickGrid *pick) {
+	gint width, height, stride, i, x, y, c, r, px, py, x0, y0, x1, y1, step;
+	float depth;
+	float *zbuf;
+	guint32 pixel;
+	guint32 *row;
+	unsigned char *data;
+	cairo_surface_t *image;
+	struct Projection proj;
+	const double *color;
+
+	width = config->absxsize + 2 * xborder;
+	if (config->tileRows > 0)
+		height = config->tileRows;
+	else
+		height = config->absysize + 2 * yborder;
+
+	image = getPixelSurface(&(buffers->pixels), width, height);
+	cairo_surface_flush(image);
+	data = cairo_image_surface_get_data(image);
+	stride = cairo_image_surface_get_stride(image);
+
+	setupProjection(extent, config, pick, &proj);
+
+	zbuf = (float *) growScratch(&(buffers->depth),
+			width * height * sizeof(float));
+	for (i = 0; i < width * height; i++)
+		zbuf[i] = -G_MAXFLOAT;
+	for (py = 0; py < height; py++)
+		memset(data + py * stride, 0, width * sizeof(guint32));
+
+	for (i = 0; i < numatoms; i++) {
+		if (!projectAtom(&proj, &coords[i], &x, &y, &c, &r))
+			continue;
+
+		/* The depth key is the rotated z coordinate, atoms with a larger
+		 key are drawn last by the sort unless it is reversed. */
+		if (config->sort == 2)
+			depth = (float) -coords[i].tcoord;
+		else
+			depth = (float) coords[i].tcoord;
+
+		if (config->mode == 0) {
+			x0 = x - r / 2;
+			y0 = y - r / 2;
+			x1 = x0 + r - 1;
+			y1 = y0 + r - 1;
+		} else {
+			x0 = x - r;
+			y0 = y - r;
+			x1 = x + r;
+			y1 = y + r;
+		}
+		if (x0 < 0)
+			x0 = 0;
+		if (y0 < 0)
+			y0 = 0;
+		if (x1 >= width)
+			x1 = width - 1;
+		if (y1 >= height)
+			y1 = height - 1;
+
+		step = getCueStep(&proj, coords[i].tcoord);
+		color = proj.shade[c][step];
+		pixel = proj.pixels[c][step];
+
+		for (py = y0; py <= y1; py++) {
+			row = (guint32 *) (data + py * stride);
+			for (px = x0; px <= x1; px++) {
+				if (zbuf[py * width + px] >= depth)
+					continue;
+				if (config->mode != 0
+						&& (px + 0.5 - x) * (px + 0.5 - x)
+								+ (py + 0.5 - y) * (py + 0.5 - y) > r * r)
+					continue;
+				if (config->mode == 2) {
+					if (!shadeBall(px + 0.5, py + 0.5, x, y, r, color,
+							&row[px]))
+						continue;
+				} else
+					row[px] = pixel;
+				zbuf[py * width + px] = depth;
+				if (proj.pick != NULL && px < proj.pick->width
+						&& py < proj.pick->height)
+					proj.pick->atoms[py * proj.pick->width + px] =
+							coords[i].index;
+			}
+		}
+	}
+
+	cairo_surface_mark_dirty(image);
+	cairo_set_source_surface(cr, image, 0, 0);
+	cairo_paint(cr);
+}